@@ -1,37 +1,205 @@
 ﻿#ifndef BUS_H
 #define BUS_H
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
+#include <cstring>
+#include <span>
+
+// 代码/数据记录（CDL）是编译期开关，关掉时所有标记都不生成代码
+#ifndef NES_CDL
+#define NES_CDL 0
+#endif
 
 namespace nes {
+
+// 总线访问的观察者，对拍和调试工具用它记录读写。
+// 只有打了陷阱标志的页才会回调，其他页的访问走快速路径
+class BusObserver {
+public:
+    virtual ~BusObserver() = default;
+    virtual void onWrite(uint16_t address, uint8_t data) = 0;
+    virtual void onRead(uint16_t, uint8_t) {}
+    // Machine 恢复了快照/检查点/存档，cycle 是恢复后的周期
+    virtual void onRestore(uint64_t) {}
+};
+
+// 挂在总线上的 I/O 寄存器（手柄等）。读写仍然落到 ram 上，
+// 设备在读的时候可以替换返回值；ram 里留的是最后一次写入的值
+class BusDevice {
+public:
+    virtual ~BusDevice() = default;
+    virtual uint8_t ioRead(uint16_t address, uint8_t data) = 0;
+    virtual void ioWrite(uint16_t address, uint8_t data) = 0;
+};
+
 class Bus {
 public:
     explicit Bus() = default;
     ~Bus() = default;
 
+    // CDL 每个地址一个字节，每次访问 OR 上对应的标志
+    enum Cdl : uint8_t
+    {
+        CDL_OPCODE = (1 << 0),
+        CDL_OPERAND = (1 << 1),
+        CDL_READ = (1 << 2),
+        CDL_WRITE = (1 << 3),
+    };
+
+    enum Trap : uint8_t
+    {
+        TRAP_READ = (1 << 0),
+        TRAP_WRITE = (1 << 1),
+        TRAP_IO = (1 << 2),     // 这一页挂了 BusDevice，由 attachDevice 设置
+    };
+
     void write(uint16_t address, uint8_t data) {
         if (address < ram.size()) {
             ram[address] = data;
         }
+        page_generation[address >> 8]++;
+        mark(address, CDL_WRITE);
+        const uint8_t trap = page_trap[address >> 8];
+        if (trap != 0) {
+            if (trap & TRAP_IO) {
+                devices[address >> 8]->ioWrite(address, data);
+            }
+            if ((trap & TRAP_WRITE) && observer != nullptr) {
+                observer->onWrite(address, data);
+            }
+        }
+        if (tracer != nullptr) {
+            tracer->onWrite(address, data);
+        }
     }
 
     uint8_t read(uint16_t address) {
+        return fetch(address, CDL_READ);
+    }
+
+    // 带 CDL 标志的读，CPU 取指令字节时用 CDL_OPCODE / CDL_OPERAND
+    uint8_t fetch(uint16_t address, uint8_t cdlFlags) {
         if (address < ram.size()) {
-            return ram[address];
+            mark(address, cdlFlags);
+            uint8_t data = ram[address];
+            const uint8_t trap = page_trap[address >> 8];
+            if (trap != 0) {
+                if (trap & TRAP_IO) {
+                    data = devices[address >> 8]->ioRead(address, data);
+                }
+                if ((trap & TRAP_READ) && observer != nullptr) {
+                    observer->onRead(address, data);
+                }
+            }
+            return data;
         }
 
         return 0x00;
     }
 
+    // 批量读写给调试界面、存档和哈希用: 按内存直接拷贝，不标记 CDL、不回调观察者，
+    // 也不会触发 I/O 寄存器的副作用。越过 $FFFF 时回绕到 $0000
+    void peek(uint16_t address, std::span<uint8_t> out) const {
+        size_t done = 0;
+        while (done < out.size()) {
+            const size_t n = std::min(out.size() - done, ram.size() - address);
+            std::memcpy(out.data() + done, ram.data() + address, n);
+            done += n;
+            address = static_cast<uint16_t>(address + n);
+        }
+    }
+
+    void poke(uint16_t address, std::span<const uint8_t> data) {
+        size_t done = 0;
+        while (done < data.size()) {
+            const size_t n = std::min(data.size() - done, ram.size() - address);
+            std::memcpy(ram.data() + address, data.data() + done, n);
+            touch(address, n);
+            done += n;
+            address = static_cast<uint16_t>(address + n);
+        }
+    }
+
+    // 设置某一页（address >> 8）的观察者陷阱标志，不影响 TRAP_IO
+    void setPageTrap(uint8_t page, uint8_t flags) {
+        page_trap[page] = static_cast<uint8_t>((page_trap[page] & TRAP_IO) | (flags & ~TRAP_IO));
+    }
+
+    void setAllPageTraps(uint8_t flags) {
+        for (size_t page = 0; page < page_trap.size(); page++) {
+            setPageTrap(static_cast<uint8_t>(page), flags);
+        }
+    }
+
+    // 把设备挂到某一页，这一页的每次读写都交给它；nullptr 表示摘掉
+    void attachDevice(uint8_t page, BusDevice* device) {
+        devices[page] = device;
+        page_trap[page] = static_cast<uint8_t>(device != nullptr ? page_trap[page] | TRAP_IO : page_trap[page] & ~TRAP_IO);
+    }
+
     void reset() noexcept {
-        for (auto& n : ram) {
-            n = 0U;
+        ram.fill(0U);
+        touchAll();
+    }
+
+    // 每页的写入代数，页里有写入就加一，调试界面据此只重画变了的部分。
+    // 绕过 write() 直接改 ram 的地方（装入程序、恢复快照）要调用 touchAll()
+    uint32_t pageGeneration(uint8_t page) const {
+        return page_generation[page];
+    }
+
+    void touchAll() {
+        for (uint32_t& g : page_generation) {
+            g++;
         }
     }
 
+    void mark(uint16_t address, uint8_t cdlFlags) {
+#if NES_CDL
+        cdl[address] |= cdlFlags;
+#else
+        (void)address;
+        (void)cdlFlags;
+#endif
+    }
+
+    uint8_t cdlFlags(uint16_t address) const {
+#if NES_CDL
+        return cdl[address];
+#else
+        (void)address;
+        return 0;
+#endif
+    }
+
+    void clearCdl() {
+#if NES_CDL
+        cdl.fill(0U);
+#endif
+    }
+
 public:
     std::array<uint8_t, 64 * 1024> ram;
+    BusObserver* observer = nullptr;
+    // 记录全部写操作的观察者，不受陷阱标志限制
+    BusObserver* tracer = nullptr;
+
+private:
+    void touch(uint16_t address, size_t len) {
+        const size_t last = (address + len - 1) >> 8;
+        for (size_t page = address >> 8; page <= last; page++) {
+            page_generation[page]++;
+        }
+    }
+
+    std::array<uint8_t, 256> page_trap{};
+    std::array<BusDevice*, 256> devices{};
+    std::array<uint32_t, 256> page_generation{};
+#if NES_CDL
+    std::array<uint8_t, 64 * 1024> cdl{};
+#endif
 };
 }
 #endif // !BUS_H
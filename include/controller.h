@@ -0,0 +1,104 @@
+﻿#ifndef CONTROLLER_H
+#define CONTROLLER_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "bus.h"
+
+namespace nes {
+
+// 标准手柄的按键位，顺序就是 $4016/$4017 串行读出的顺序
+enum Button : uint8_t
+{
+    BUTTON_A = (1 << 0),
+    BUTTON_B = (1 << 1),
+    BUTTON_SELECT = (1 << 2),
+    BUTTON_START = (1 << 3),
+    BUTTON_UP = (1 << 4),
+    BUTTON_DOWN = (1 << 5),
+    BUTTON_LEFT = (1 << 6),
+    BUTTON_RIGHT = (1 << 7),
+};
+
+// 手柄按键的无锁快照: 平台事件线程一收到按键就改，模拟线程在游戏读端口的那一刻取，
+// 中间不经过界面帧。每个端口一个 64 位原子量，低 8 位是按键，高 56 位是最后一次变化的
+// steady_clock 时刻（纳秒），一次读就拿到一致的一对，测输入延迟用
+class InputState {
+public:
+    static constexpr size_t PORTS = 2;
+
+    explicit InputState() = default;
+
+    InputState(const InputState&) = delete;
+    void operator=(const InputState&) = delete;
+
+    void set(size_t port, uint8_t buttons);
+    void press(size_t port, uint8_t mask);
+    void release(size_t port, uint8_t mask);
+
+    uint64_t sample(size_t port) const {
+        return ports[port].load(std::memory_order_acquire);
+    }
+
+    static uint8_t buttons(uint64_t sample) { return static_cast<uint8_t>(sample); }
+    static uint64_t stamp(uint64_t sample) { return sample >> 8; }
+
+    // 和 stamp() 同一时间基准的当前时刻，差值按 56 位回绕
+    static uint64_t now();
+    static uint64_t elapsed(uint64_t since) { return (now() - since) & STAMP_MASK; }
+
+private:
+    static constexpr uint64_t STAMP_MASK = (uint64_t(1) << 56) - 1;
+
+    void update(size_t port, uint8_t set, uint8_t clear);
+
+    std::array<std::atomic<uint64_t>, PORTS> ports{};
+};
+
+// $4016/$4017 上的两个标准手柄。写 $4016 的 bit0 控制选通: 选通为高时一直重新装入，
+// 变低的那一刻锁存；之后每次读移出一位，8 位之后读出 1。
+// 接了 InputState 时锁存的是那一刻的快照，否则用 setButtons 给的值（批量运行、回放）
+class Controllers : public BusDevice {
+public:
+    struct State
+    {
+        uint8_t strobe = 0;
+        std::array<uint8_t, InputState::PORTS> shift{};
+    };
+
+    explicit Controllers() = default;
+
+    Controllers(const Controllers&) = delete;
+    void operator=(const Controllers&) = delete;
+
+    // 挂到 $4000 页上 / 摘下
+    void attach(Bus& bus);
+    void detach(Bus& bus);
+
+    void connect(const InputState* source) { input = source; }
+    void setButtons(size_t port, uint8_t buttons) { fixed[port] = buttons; }
+
+    // 最近一次锁存到的按键变化时刻（InputState 的时间基准），0 表示没锁存过接入的输入
+    uint64_t latchedStamp(size_t port) const { return latched_stamp[port]; }
+
+    uint8_t ioRead(uint16_t address, uint8_t data) override;
+    void ioWrite(uint16_t address, uint8_t data) override;
+
+    State saveState() const { return state; }
+    void loadState(const State& s) { state = s; }
+    void reset() { state = State{}; }
+
+private:
+    void latch();
+
+    const InputState* input = nullptr;
+    std::array<uint8_t, InputState::PORTS> fixed{};
+    std::array<uint64_t, InputState::PORTS> latched_stamp{};
+    State state;
+};
+}
+
+#endif // !CONTROLLER_H
@@ -0,0 +1,126 @@
+﻿#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "bus.h"
+#include "machine.h"
+
+namespace nes {
+
+// 断点/观察点的条件表达式，编译成栈式字节码，求值时不再解析字符串。
+// 语法: 数字（$FF、0xFF、255），寄存器 A X Y SP PC P，
+// VALUE（观察点读写的值 / 断点处的操作码），ADDR（访问的地址），[expr] 读内存，
+// 一元 ! - ~，二元 * + - << >> & ^ | == != < <= > >= && ||，括号
+class Condition {
+public:
+    bool compile(const std::string& text, std::string& error);
+
+    bool empty() const { return code.empty(); }
+    const std::string& text() const { return source; }
+
+    int32_t evaluate(const Machine& machine, uint16_t address, uint8_t value) const;
+
+private:
+    enum Op : uint8_t
+    {
+        PUSH, REG_A, REG_X, REG_Y, REG_SP, REG_PC, REG_P, VALUE, ADDR, LOAD,
+        NEG, NOT, BNOT,
+        MUL, ADD, SUB, SHL, SHR, AND, XOR, OR,
+        EQ, NE, LT, LE, GT, GE, LAND, LOR,
+    };
+
+    struct Insn
+    {
+        Op op;
+        int32_t imm;
+    };
+
+    static constexpr size_t MAX_STACK = 32;
+
+    struct Parser;
+
+    std::vector<Insn> code;
+    std::string source;
+};
+
+// 执行断点 + 读写观察点。
+// 执行断点存成 64K 位的位图，只有位图非空时才在每条指令后查一次；
+// 观察点只给被观察的页打上总线陷阱标志，其他页的读写不受影响
+class Debugger : public BusObserver {
+public:
+    enum class Stop : uint8_t { NONE, BREAKPOINT, WATCH_READ, WATCH_WRITE };
+
+    struct Hit
+    {
+        Stop reason = Stop::NONE;
+        uint16_t address = 0x0000;
+        uint8_t value = 0x00;
+    };
+
+    // 挂到机器的总线上作为观察者，析构时摘下
+    explicit Debugger(Machine& machine);
+    ~Debugger() override;
+
+    Debugger(const Debugger&) = delete;
+    void operator=(const Debugger&) = delete;
+
+    // condition 为空表示无条件断点
+    bool setBreakpoint(uint16_t address, const std::string& condition, std::string& error);
+    void clearBreakpoint(uint16_t address);
+    void clearBreakpoints();
+    // 切换无条件断点，返回切换后是否有断点
+    bool toggleBreakpoint(uint16_t address);
+
+    bool hasBreakpoint(uint16_t address) const {
+        return (exec_bits[address >> 6] >> (address & 63)) & 1;
+    }
+
+    size_t breakpointCount() const { return exec_count; }
+
+    // access 是 Bus::TRAP_READ / Bus::TRAP_WRITE 的组合
+    bool setWatchpoint(uint16_t address, uint16_t length, uint8_t access, const std::string& condition, std::string& error);
+    void clearWatchpoints();
+    size_t watchpointCount() const { return watches.size(); }
+
+    // 执行一条指令；触发观察点时返回原因
+    Stop step();
+
+    // 自由运行直到命中断点/观察点或跑满 cycles 个周期。
+    // 第一条指令总会执行，所以停在断点上时可以直接继续
+    Stop run(uint64_t cycles);
+
+    const Hit& lastHit() const { return last; }
+
+    void onWrite(uint16_t address, uint8_t data) override;
+    void onRead(uint16_t address, uint8_t data) override;
+
+private:
+    struct Watch
+    {
+        uint16_t address;
+        uint32_t end;
+        uint8_t access;
+        Condition condition;
+    };
+
+    void check(Stop reason, uint8_t access, uint16_t address, uint8_t data);
+    bool breakAt(uint16_t pc) const;
+    void updatePageTraps();
+
+    Machine& machine;
+    std::array<uint64_t, 1024> exec_bits{};
+    size_t exec_count = 0;
+    std::unordered_map<uint16_t, Condition> conditions;
+    std::vector<Watch> watches;
+    Hit pending;
+    Hit last;
+};
+}
+
+#endif // !DEBUGGER_H
@@ -0,0 +1,125 @@
+﻿#ifndef EMU_THREAD_H
+#define EMU_THREAD_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "debugger.h"
+#include "flow_graph.h"
+#include "machine.h"
+#include "time_travel.h"
+#include "triple_buffer.h"
+
+namespace nes {
+
+// 在独立线程上跑模拟，界面线程只通过命令队列下指令、通过三缓冲读状态，两边互不阻塞。
+// 每到帧边界（或执行完一条命令）发布一份完整的状态: 寄存器、关注的内存页和 PC 附近的反汇编。
+// start() 之后 machine / debugger / history 只能由模拟线程访问
+class EmuThread {
+public:
+    static constexpr size_t MAX_PAGES = 4;
+    static constexpr size_t CODE_LINES = 27;    // PC 所在行在正中间
+
+    enum class Command : uint8_t
+    {
+        STEP,
+        REVERSE_STEP,
+        REVERSE_CONTINUE,
+        TOGGLE_BREAKPOINT,  // 在当前 PC 上
+        RUN_PAUSE,
+        RESET,
+        IRQ,
+        NMI,
+        THROTTLE,           // 在按 60Hz 限速和全速之间切换
+    };
+
+    struct CodeLine
+    {
+        uint16_t address;
+        bool breakpoint;
+        char text[32];      // 空串表示这一行没有代码
+    };
+
+    struct State
+    {
+        uint64_t sequence;  // 发布的序号，0 表示还没有发布过
+        uint64_t cycle;
+        uint64_t frame;
+        uint16_t pc;
+        uint8_t a;
+        uint8_t x;
+        uint8_t y;
+        uint8_t sp;
+        uint8_t status;
+        bool running;
+        bool throttled;
+        bool stopped;       // 命中了断点/观察点，继续运行后清掉
+        uint16_t stopAddress;
+        uint64_t inputStamp;    // 游戏最近一次读 1P 手柄时锁存到的按键变化时刻，见 InputState
+        size_t pageCount;
+        std::array<uint8_t, MAX_PAGES> pageNumbers;
+        std::array<uint32_t, MAX_PAGES> pageGenerations;    // Bus::pageGeneration，没变就不用比较内容
+        std::array<std::array<uint8_t, 256>, MAX_PAGES> pages;
+        std::array<CodeLine, CODE_LINES> code;
+    };
+
+    explicit EmuThread(Machine& machine, Debugger& debugger, TimeTravel& history);
+    ~EmuThread();
+
+    EmuThread(const EmuThread&) = delete;
+    void operator=(const EmuThread&) = delete;
+
+    // start() 之前调用，最多 MAX_PAGES 页
+    bool watchPage(uint8_t page);
+
+    void start();
+    void stop();
+
+    // 界面线程调用；队列满时丢掉并返回 false
+    bool post(Command command);
+
+    // 界面线程调用，拿最近一次发布的状态
+    const State& latest() { return states.latest(); }
+
+private:
+    static constexpr uint32_t QUEUE_SIZE = 64;
+
+    void threadLoop();
+    void execute(Command command);
+    void runFrame();
+    void publish();
+
+    Machine& machine;
+    Debugger& debugger;
+    TimeTravel& history;
+    ControlFlowGraph cfg;
+    std::map<uint16_t, std::string> code;
+
+    std::array<uint8_t, MAX_PAGES> page_numbers{};
+    size_t page_count = 0;
+
+    // 单生产者/单消费者的命令环
+    std::array<Command, QUEUE_SIZE> queue{};
+    std::atomic<uint32_t> posted{ 0 };
+    std::atomic<uint32_t> taken{ 0 };
+    std::atomic<uint32_t> signal{ 0 };      // 唤醒暂停中的模拟线程用
+    std::atomic<bool> stopping{ false };
+
+    // 只在模拟线程上用
+    bool running = false;
+    bool throttled = true;
+    bool stopped = false;
+    uint16_t stop_address = 0x0000;
+    uint64_t sequence = 0;
+
+    TripleBuffer<State> states;
+    std::thread worker;
+};
+}
+
+#endif // !EMU_THREAD_H
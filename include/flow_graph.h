@@ -0,0 +1,89 @@
+﻿#ifndef FLOW_GRAPH_H
+#define FLOW_GRAPH_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "bus.h"
+#include "olc6502.h"
+
+namespace nes {
+
+// 递归下降的控制流分析: 从复位/NMI/IRQ 向量、CDL 里执行过的地址和额外入口出发，
+// 沿分支、JMP、JSR 走遍可达的指令，切分成基本块。
+// 结果只取决于分析时解码过的字节和入口，这些都没变时直接用上次的结果
+class ControlFlowGraph {
+public:
+    enum class Exit : uint8_t
+    {
+        FALLTHROUGH,    // 下一条指令是另一个块的入口
+        BRANCH,         // 条件分支: 目标 + 顺序执行
+        JUMP,           // JMP abs
+        JUMP_INDIRECT,  // JMP (ind)，目标未知
+        CALL,           // JSR: 子程序 + 返回地址
+        RETURN,         // RTS / RTI
+        HALT,           // BRK 或非官方指令，当作代码的终点
+    };
+
+    struct Block
+    {
+        uint16_t start = 0x0000;
+        uint16_t last = 0x0000;     // 最后一条指令的地址
+        uint16_t size = 0;          // 字节数
+        uint16_t count = 0;         // 指令条数
+        Exit exit = Exit::FALLTHROUGH;
+        std::vector<uint16_t> successors;
+    };
+
+    explicit ControlFlowGraph(const OLC6502& cpu);
+
+    // 额外的入口，比如调试时实际执行过的 PC
+    void addEntry(uint16_t address);
+    void clearEntries();
+
+    // 是否把 CDL 里标记为操作码的地址也当作入口
+    void setUseCdl(bool use) { use_cdl = use; }
+
+    // 分析 bus 上的 64K 地址空间；命中缓存时返回 false
+    bool analyze(const Bus& bus);
+
+    // 按起始地址排序
+    const std::vector<Block>& blocks() const { return block_list; }
+
+    // 包含 address 的块，不在任何块里时返回 nullptr
+    const Block* blockAt(uint16_t address) const;
+
+    bool isInstruction(uint16_t address) const {
+        return (instruction_bits[address >> 6] >> (address & 63)) & 1;
+    }
+
+    // 按块反汇编，只输出分析到的指令，格式和 OLC6502::disassemble 一样
+    std::map<uint16_t, std::string> disassemble(OLC6502& cpu) const;
+
+private:
+    Exit exitOf(uint8_t opcode) const;
+    std::vector<uint16_t> collectEntries(const Bus& bus) const;
+    uint64_t codeHash(const Bus& bus) const;
+
+    const OLC6502& cpu;
+    std::array<Exit, 256> exits{};
+    std::array<bool, 256> branch{};
+    std::vector<uint16_t> extra_entries;
+    bool use_cdl = true;
+
+    std::vector<Block> block_list;
+    std::array<uint64_t, 1024> instruction_bits{};
+    std::array<int32_t, 64 * 1024> block_index{};
+
+    // 缓存: 入口集合 + 解码过的字节
+    bool valid = false;
+    std::vector<uint16_t> cached_entries;
+    uint64_t cached_hash = 0;
+};
+}
+
+#endif // !FLOW_GRAPH_H
@@ -0,0 +1,164 @@
+﻿#ifndef MACHINE_H
+#define MACHINE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "bus.h"
+#include "controller.h"
+#include "olc6502.h"
+#include "ppu.h"
+
+namespace nes {
+
+// NTSC: 每帧 341 * 262 个 PPU 点，CPU 时钟是 PPU 的 1/3，所以一帧约 29780.67 个 CPU 周期
+constexpr uint64_t PPU_DOTS_PER_FRAME = 341 * 262;
+
+// 还没有 PPU，画面取自 $0200-$05FF 的 32x32 显存，每个字节是一个调色板索引
+constexpr int SCREEN_WIDTH = 32;
+constexpr int SCREEN_HEIGHT = 32;
+constexpr uint16_t SCREEN_ADDRESS = 0x0200;
+
+// FULL: 每帧结束时查调色板生成 RGBA 画面并交给 FrameSink；
+// RAM_ONLY: 跳过所有画面输出，只跑 CPU；
+// PIPELINED: 显存和 PPU 寄存器的写入记成日志，由渲染线程晚一帧重放出画面，FrameSink 在渲染线程上调用。
+// 三种模式下帧边界和 CPU 可见的状态完全一样，FULL 和 PIPELINED 的画面逐帧一致
+enum class RenderMode : uint8_t { FULL, RAM_ONLY, PIPELINED };
+
+class VideoPipeline;
+
+class FrameSink {
+public:
+    virtual ~FrameSink() = default;
+    virtual void onFrame(const uint32_t* rgba, int width, int height) = 0;
+};
+
+// 一台完整的机器: CPU + 总线。工具和批量运行都用它，而不是各自拼装
+class Machine {
+public:
+    explicit Machine();
+    ~Machine();
+
+    Machine(const Machine&) = delete;
+    void operator=(const Machine&) = delete;
+
+    // 把程序装到 address 处，超出 64K 的部分丢弃
+    void load(uint16_t address, const uint8_t* data, size_t len);
+    void setResetVector(uint16_t address);
+
+    // 装入测试程序文件:
+    // .nes 跳过 iNES 头，PRG 装入 $8000（16K 的镜像到 $C000），使用自带的复位向量；
+    // 64K 的 .bin 作为整个地址空间的镜像从 $0000 装入，也使用自带的复位向量；
+    // 其他文件原样装入 address，复位向量指向 address
+    bool loadFile(const std::string& path, uint16_t address, std::string& error);
+
+    void reset();
+
+    // 把手柄挂到 $4016/$4017。默认不挂，把这两个地址当 RAM 的测试程序和参考实现不受影响
+    void setControllers(bool enabled);
+
+    // 把 PPU 寄存器挂到 $2000-$3FFF: vblank 时置 $2002 的 bit7，$2000 打开 NMI 时发 NMI。
+    // 默认不挂，把整个地址空间当 RAM 用的测试程序不受影响
+    void setPpu(bool enabled);
+
+    // 执行一条完整指令，越过帧边界时结束这一帧
+    void step();
+
+    // 按指令边界运行，直到至少跑完 cycles 个周期，返回实际运行的周期数
+    uint64_t run(uint64_t cycles);
+
+    // 运行 frames 帧，按指令边界停在帧边界之后，返回实际运行的周期数
+    uint64_t runFrames(uint32_t frames);
+
+    uint64_t cycleCount() const { return cpu.getCycleCount(); }
+    uint64_t frameCount() const { return frame_count; }
+    // 每次恢复快照/检查点/存档加一，记录执行历史的工具据此发现时间线被改写；
+    // restoreCycle 是最近一次恢复到的周期。恢复时还会通知总线上的 tracer
+    uint64_t restoreCount() const { return restore_count; }
+    uint64_t restoreCycle() const { return restore_cycle; }
+
+    // 第一次切到 PIPELINED 时启动渲染线程；只在 PIPELINED 下记日志，
+    // 切到别的模式时摘下日志并等渲染线程处理完，切回来时整块重新同步
+    void setRenderMode(RenderMode mode);
+    RenderMode renderMode() const { return render_mode; }
+    void setFrameSink(FrameSink* sink) { frame_sink = sink; }
+
+    // 等渲染线程把已经跑完的帧都交给 FrameSink，PIPELINED 模式下读 sink 的结果前调用
+    void flushVideo();
+
+    // 最近一帧的 RGBA 画面，只在 FULL 模式下更新
+    const uint32_t* frame() const { return framebuffer.data(); }
+
+    // 内存里的完整快照，需要频繁存取的地方（回退、预测执行）直接用它
+    struct Snapshot
+    {
+        OLC6502::State cpu;
+        Controllers::State controllers;
+        PpuRegisters::State ppu;
+        uint64_t frame_count = 0;
+        std::array<uint8_t, 64 * 1024> ram;
+    };
+
+    void saveSnapshot(Snapshot& snapshot) const;
+    void loadSnapshot(const Snapshot& snapshot);
+
+    // 增量快照: 按 Bus::pageGeneration 只拷贝上次保存/恢复以来写过的页，
+    // 每帧都要存取一次的地方（预测执行）用它，开销随写过的页数而不是 64K 增长。
+    // 第一次保存是完整拷贝；绕过 Bus 直接改 ram 的地方要先 touchAll()
+    struct Checkpoint
+    {
+        OLC6502::State cpu;
+        Controllers::State controllers;
+        PpuRegisters::State ppu;
+        uint64_t frame_count = 0;
+        bool valid = false;
+        std::array<uint32_t, 256> generations{};   // 每页内容和 ram 一致时的写入代数
+        std::array<uint8_t, 64 * 1024> ram;
+    };
+
+    void saveCheckpoint(Checkpoint& checkpoint) const;
+    void loadCheckpoint(Checkpoint& checkpoint);
+
+    // 按 FCEUX 的 .cdl 格式导出代码/数据记录: 每个 PRG 字节一个标志字节，后面跟 CHR 部分。
+    // 没有装入 .nes 时把 $8000-$FFFF 当作 32K 的 PRG。需要用 -DNES_CDL=ON 构建
+    bool saveCdl(const std::string& path, std::string& error) const;
+
+    // 与平台无关的存档格式（小端），文件和 C 接口用它
+    static size_t stateSize();
+    bool saveState(uint8_t* buffer, size_t size) const;
+    bool loadState(const uint8_t* buffer, size_t size);
+
+public:
+    std::shared_ptr<Bus> bus = std::make_shared<Bus>();
+    OLC6502 cpu;
+    // $4016/$4017 上的手柄，setControllers(true) 之后挂到总线上
+    Controllers controllers;
+    // setPpu(true) 之后挂到 $2000-$3FFF
+    PpuRegisters ppu;
+
+private:
+    void scheduleFrame();
+    void endFrame();
+    void renderFrame();
+    void resyncVideo();
+    void restored();
+
+    uint64_t frame_count = 0;
+    uint64_t restore_count = 0;
+    uint64_t restore_cycle = 0;
+    size_t prg_size = 0x8000;
+    size_t chr_size = 0;
+    uint64_t frame_end = PPU_DOTS_PER_FRAME / 3;
+    uint64_t vblank_at = VBLANK_START_CYCLE;    // 已经过了就是 UINT64_MAX
+    bool ppu_enabled = false;
+    RenderMode render_mode = RenderMode::FULL;
+    FrameSink* frame_sink = nullptr;
+    std::array<uint32_t, SCREEN_WIDTH * SCREEN_HEIGHT> framebuffer{};
+    std::unique_ptr<VideoPipeline> pipeline;
+};
+}
+
+#endif // !MACHINE_H
@@ -0,0 +1,85 @@
+﻿#ifndef NES_C_H
+#define NES_C_H
+
+/*
+ * nes_c 共享库的 C 接口。句柄不透明，所有函数都不抛异常：
+ * 库内部的异常（内存不足、文件读取出错等）在边界上捕获，返回 NES_ERR_INTERNAL。
+ * 批量接口（nes_run_frames_batch）一次调用推进多台机器，
+ * 在库内部的常驻线程池上并行执行。
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(NES_C_BUILD)
+#define NES_API __declspec(dllexport)
+#else
+#define NES_API __declspec(dllimport)
+#endif
+#else
+#define NES_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NES_API_VERSION 1
+
+/* 返回码 */
+#define NES_OK 0
+#define NES_ERR_ARG (-1)
+#define NES_ERR_SIZE (-2)
+#define NES_ERR_FORMAT (-3)
+#define NES_ERR_IO (-4)
+#define NES_ERR_INTERNAL (-5)
+
+typedef struct nes_machine nes_machine;
+
+typedef struct nes_registers
+{
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t sp;
+    uint8_t status;
+    uint16_t pc;
+} nes_registers;
+
+NES_API int nes_api_version(void);
+
+/* 失败时返回 NULL */
+NES_API nes_machine* nes_create(void);
+NES_API void nes_destroy(nes_machine* machine);
+
+/* 把 data 装入 address 处（超出 64K 的部分丢弃） */
+NES_API int nes_load(nes_machine* machine, uint16_t address, const uint8_t* data, size_t len);
+/* 装入 .bin/.nes 文件，规则同 nes_regress */
+NES_API int nes_load_file(nes_machine* machine, const char* path, uint16_t address);
+NES_API int nes_set_reset_vector(nes_machine* machine, uint16_t address);
+NES_API int nes_reset(nes_machine* machine);
+
+/* 运行 frames 帧，返回实际运行的 CPU 周期数 */
+NES_API uint64_t nes_run_frames(nes_machine* machine, uint32_t frames);
+/* 每台机器各运行 frames 帧，count 台机器并行推进 */
+NES_API int nes_run_frames_batch(nes_machine* const* machines, size_t count, uint32_t frames);
+
+/* 无副作用地批量读写内存，地址超过 $FFFF 时回绕 */
+NES_API int nes_peek(const nes_machine* machine, uint16_t address, uint8_t* out, size_t len);
+NES_API int nes_poke(nes_machine* machine, uint16_t address, const uint8_t* data, size_t len);
+
+NES_API int nes_get_registers(const nes_machine* machine, nes_registers* out);
+NES_API uint64_t nes_cycle_count(const nes_machine* machine);
+NES_API uint64_t nes_frame_count(const nes_machine* machine);
+
+/* 存档缓冲区的字节数，与平台无关 */
+NES_API size_t nes_state_size(void);
+NES_API int nes_save_state(const nes_machine* machine, uint8_t* buffer, size_t size);
+NES_API int nes_load_state(nes_machine* machine, const uint8_t* buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !NES_C_H */
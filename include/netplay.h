@@ -0,0 +1,142 @@
+﻿#ifndef NETPLAY_H
+#define NETPLAY_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "machine.h"
+
+namespace nes {
+
+// 联机对战用的数据报通道，不保证送达和顺序，两端都不阻塞
+class Transport {
+public:
+    virtual ~Transport() = default;
+    virtual void send(const uint8_t* data, size_t len) = 0;
+    // 没有数据时返回 0，数据报比 capacity 长时截断
+    virtual size_t receive(uint8_t* data, size_t capacity) = 0;
+};
+
+// 进程内的一对端点，测试用；可以给每个数据报加上固定延迟
+class LoopbackTransport : public Transport {
+public:
+    static void makePair(std::unique_ptr<LoopbackTransport>& a, std::unique_ptr<LoopbackTransport>& b,
+        std::chrono::microseconds delay = std::chrono::microseconds(0));
+
+    void send(const uint8_t* data, size_t len) override;
+    size_t receive(uint8_t* data, size_t capacity) override;
+
+private:
+    struct Packet
+    {
+        std::chrono::steady_clock::time_point due;
+        std::vector<uint8_t> data;
+    };
+
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<Packet> packets;
+    };
+
+    std::shared_ptr<Queue> inbox;
+    std::shared_ptr<Queue> outbox;
+    std::chrono::microseconds delay{ 0 };
+};
+
+// 本机回环上的 UDP
+class UdpTransport : public Transport {
+public:
+    explicit UdpTransport() = default;
+    ~UdpTransport();
+
+    UdpTransport(const UdpTransport&) = delete;
+    void operator=(const UdpTransport&) = delete;
+
+    // 绑定 127.0.0.1:localPort，发往 127.0.0.1:remotePort
+    bool open(uint16_t localPort, uint16_t remotePort, std::string& error);
+    void close();
+
+    void send(const uint8_t* data, size_t len) override;
+    size_t receive(uint8_t* data, size_t capacity) override;
+
+private:
+    intptr_t sock = -1;
+    uint16_t remote_port = 0;
+};
+
+// GGPO 式的回滚联机: 本地输入立刻生效，对方的输入先按最后一次确认的值预测，
+// 每帧开始前存增量检查点。收到的真实输入和预测不一致时，恢复到那一帧的检查点，
+// 用确认的输入不出画面地重放到当前帧。对方落后太多、预测超过 MAX_ROLLBACK 帧时停下来等
+class RollbackSession {
+public:
+    static constexpr uint32_t MAX_ROLLBACK = 8;
+
+    struct Stats
+    {
+        uint64_t rollbacks = 0;
+        uint64_t resimulated = 0;       // 重放的帧数
+        uint32_t longestRollback = 0;   // 一次最多重放的帧数
+        double totalRollbackMicros = 0.0;
+        double maxRollbackMicros = 0.0; // 恢复加重放
+        uint64_t stalls = 0;            // 等对方而没推进的帧
+    };
+
+    // player 是本地玩家用的手柄端口（0 或 1），两端必须从相同的机器状态开始
+    explicit RollbackSession(Machine& machine, Transport& transport, size_t player);
+    ~RollbackSession() = default;
+
+    RollbackSession(const RollbackSession&) = delete;
+    void operator=(const RollbackSession&) = delete;
+
+    // 每个显示帧调用一次: 收对方输入、必要时回滚，再用 buttons 推进一帧。
+    // 要等对方时不推进，返回 false
+    bool advanceFrame(uint8_t buttons);
+
+    // 只收包和回滚、不推进，结束时等对方的输入全部到齐用
+    void poll();
+
+    uint32_t frame() const { return current; }
+    // 对方输入已确认到的帧数（这之前的帧都不会再回滚）
+    uint32_t confirmedFrames() const { return confirmed; }
+    const Stats& stats() const { return statistics; }
+
+private:
+    // 对方最多领先 2 * MAX_ROLLBACK - 1 帧，包里带最近 RING 帧的本地输入，丢包后下一个包能补上
+    static constexpr uint32_t RING = 2 * MAX_ROLLBACK;
+    static constexpr size_t PACKET_SIZE = 7 + RING;
+
+    struct Slot
+    {
+        uint8_t local = 0;
+        uint8_t remote = 0;     // 确认的或预测的
+        std::unique_ptr<Machine::Checkpoint> checkpoint = std::make_unique<Machine::Checkpoint>();
+    };
+
+    void receive();
+    void rollback();
+    void sendInputs();
+    void runFrame(uint32_t frame, RenderMode mode);
+
+    Machine& machine;
+    Transport& transport;
+    size_t local_port;
+    std::array<Slot, RING> slots;
+
+    uint32_t current = 0;       // 下一帧要跑的帧号
+    uint32_t confirmed = 0;     // 对方 [0, confirmed) 的输入已经到了
+    uint32_t mispredicted = UINT32_MAX;    // 最早用错了预测的帧
+    uint8_t last_remote = 0;    // 最后确认的对方输入，预测用
+    RenderMode display_mode;
+    Stats statistics;
+};
+}
+
+#endif // !NETPLAY_H
@@ -1,6 +1,7 @@
 ﻿#ifndef OLC6502_H
 #define OLC6502_H
 
+#include <array>
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -24,6 +25,7 @@ public:
 
     void connectBus(const std::shared_ptr<Bus>& bus) {
         this->bus = bus;
+        bus_ptr = bus.get();
     }
 
     void write(uint16_t address, uint8_t data);
@@ -38,6 +40,56 @@ public:
     std::map<uint16_t, std::string> disassemble(uint16_t nStart, uint16_t len);
     bool complete();
 
+    // 一次记完当前指令剩下的周期，效果和一直 clock() 到 complete() 一样。
+    // 不需要逐周期交错的地方（Machine::step）用它，省掉每个周期两次函数调用
+    void finishInstruction() {
+        cycle_count += cycles;
+        cycles = 0;
+    }
+
+    uint64_t getCycleCount() const {
+        return cycle_count;
+    }
+
+    // 操作码对应的助记符，非官方指令为 "???"
+    const std::string& getInstructionName(uint8_t opcode) const {
+        return lookup[opcode].name;
+    }
+
+    // 当前（最近一条）指令的起始地址
+    uint16_t getInstructionPc() const {
+        return instruction_pc;
+    }
+
+    // 指令总长度（操作码 + 操作数），1 到 3 个字节
+    uint8_t getInstructionLength(uint8_t opcode) const {
+        return instruction_length[opcode];
+    }
+
+    // 当前指令还剩下的周期数
+    uint8_t getRemainingCycles() const {
+        return cycles;
+    }
+
+    // CPU 的全部内部状态，存档/读档以及不走复位向量的快速复位都用它
+    struct State
+    {
+        uint8_t  a = 0x00;
+        uint8_t  x = 0x00;
+        uint8_t  y = 0x00;
+        uint8_t  sp = 0x00;
+        uint16_t pc = 0x0000;
+        uint8_t  status = 0x00;
+        uint16_t addr_abs = 0x0000;
+        uint16_t addr_rel = 0x0000;
+        uint8_t  opcode = 0x00;
+        uint8_t  cycles = 0x00;
+        uint64_t cycle_count = 0LLU;
+    };
+
+    State saveState() const;
+    void loadState(const State& state);
+
 public:
     enum Flag : uint8_t
     {
@@ -99,11 +151,16 @@ private:
 
 private:
     std::weak_ptr<Bus> bus;
+    // 每次读写都 lock() 一次 weak_ptr 是两次原子操作，占了模拟时间的一大半；
+    // 取指和读写走裸指针，总线由 Machine 持有，活得比 CPU 的使用久
+    Bus* bus_ptr = nullptr;
     uint16_t addr_abs = 0x0000;
     uint16_t addr_rel = 0x0000;
     uint8_t opcode = 0x00;
     uint8_t cycles = 0x00;
     uint64_t cycle_count = 0LLU;
+    uint16_t instruction_pc = 0x0000;
+    uint8_t instruction_bytes = 1;
 
     struct Instruction
     {
@@ -132,8 +189,8 @@ private:
         { "BEQ", &nes::OLC6502::BEQ, &nes::OLC6502::REL, 2 },{ "SBC", &nes::OLC6502::SBC, &nes::OLC6502::IZY, 5 },{ "???", &nes::OLC6502::XXX, &nes::OLC6502::IMP, 2 },{ "???", &nes::OLC6502::XXX, &nes::OLC6502::IMP, 8 },{ "???", &nes::OLC6502::NOP, &nes::OLC6502::IMP, 4 },{ "SBC", &nes::OLC6502::SBC, &nes::OLC6502::ZPX, 4 },{ "INC", &nes::OLC6502::INC, &nes::OLC6502::ZPX, 6 },{ "???", &nes::OLC6502::XXX, &nes::OLC6502::IMP, 6 },{ "SED", &nes::OLC6502::SED, &nes::OLC6502::IMP, 2 },{ "SBC", &nes::OLC6502::SBC, &nes::OLC6502::ABY, 4 },{ "NOP", &nes::OLC6502::NOP, &nes::OLC6502::IMP, 2 },{ "???", &nes::OLC6502::XXX, &nes::OLC6502::IMP, 7 },{ "???", &nes::OLC6502::NOP, &nes::OLC6502::IMP, 4 },{ "SBC", &nes::OLC6502::SBC, &nes::OLC6502::ABX, 4 },{ "INC", &nes::OLC6502::INC, &nes::OLC6502::ABX, 7 },{ "???", &nes::OLC6502::XXX, &nes::OLC6502::IMP, 7 },
     };
 
-
-
+    std::array<uint8_t, 256> instructionLengths() const;
+    const std::array<uint8_t, 256> instruction_length = instructionLengths();
 };
 }
 
@@ -0,0 +1,162 @@
+﻿#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace nes {
+
+inline unsigned defaultThreadCount()
+{
+    const unsigned n = std::thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+// 把 [0, count) 分给 threads 个线程，按原子计数器领取任务，
+// 各任务耗时差别很大时也能保持负载均衡
+template <typename Fn>
+void parallelFor(size_t count, Fn&& fn, unsigned threads = 0)
+{
+    if (threads == 0) {
+        threads = defaultThreadCount();
+    }
+    threads = static_cast<unsigned>(std::min<size_t>(threads, count));
+    if (threads <= 1) {
+        for (size_t i = 0; i < count; i++) {
+            fn(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next { 0 };
+    auto worker = [&]()
+    {
+        for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+            fn(i);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (unsigned t = 1; t < threads; t++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : pool) {
+        t.join();
+    }
+}
+
+// 常驻线程池。批量接口每次调用都会派发任务，
+// 用常驻线程避免每次都创建/销毁线程的开销
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threads = 0) {
+        if (threads == 0) {
+            threads = defaultThreadCount();
+        }
+        // 调用线程自己也干活，所以只需要 threads - 1 个后台线程
+        for (unsigned t = 1; t < threads; t++) {
+            workers.emplace_back(&ThreadPool::workerLoop, this);
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : workers) {
+            t.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    void operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+    // 和 nes::parallelFor 一样按原子计数器分发 [0, count)，全部完成后返回。
+    // 同一时间只能有一个线程调用
+    template <typename Fn>
+    void parallelFor(size_t count, Fn&& fn) {
+        if (count == 0) {
+            return;
+        }
+        if (workers.empty() || count == 1) {
+            for (size_t i = 0; i < count; i++) {
+                fn(i);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            using F = std::remove_reference_t<Fn>;
+            job = [](void* ctx, size_t i) { (*static_cast<F*>(ctx))(i); };
+            jobContext = const_cast<void*>(static_cast<const void*>(std::addressof(fn)));
+            jobCount = count;
+            next.store(0, std::memory_order_relaxed);
+            busy = static_cast<unsigned>(workers.size());
+            generation++;
+        }
+        wake.notify_all();
+
+        drain();
+
+        std::unique_lock<std::mutex> guard(lock);
+        done.wait(guard, [this] { return busy == 0; });
+    }
+
+private:
+    void drain() {
+        for (size_t i = next.fetch_add(1); i < jobCount; i = next.fetch_add(1)) {
+            job(jobContext, i);
+        }
+    }
+
+    void workerLoop() {
+        uint64_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                wake.wait(guard, [&] { return stopping || generation != seen; });
+                if (stopping) {
+                    return;
+                }
+                seen = generation;
+            }
+
+            drain();
+
+            std::lock_guard<std::mutex> guard(lock);
+            if (--busy == 0) {
+                done.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    void (*job)(void*, size_t) = nullptr;
+    void* jobContext = nullptr;
+    size_t jobCount = 0;
+    std::atomic<size_t> next { 0 };
+    unsigned busy = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+};
+}
+
+#endif // !PARALLEL_H
@@ -0,0 +1,66 @@
+﻿#ifndef PPU_H
+#define PPU_H
+
+#include <cstdint>
+
+#include "bus.h"
+
+namespace nes {
+
+class VideoPipeline;
+
+// NTSC 时序，单位是 CPU 周期: vblank 从第 241 行第 1 点开始，到帧尾（预渲染行）结束
+constexpr uint64_t VBLANK_START_CYCLE = (241 * 341 + 1) / 3;
+
+// $2001 的灰度位，渲染时只保留亮度
+constexpr uint8_t PPU_MASK_GREYSCALE = 0x01;
+
+// 把 32x32 的显存按 $2001 的设置查调色板转成 RGBA，同步和流水线渲染共用，保证结果一致
+void renderScreen(const uint8_t* screen, uint8_t mask, uint32_t* out);
+
+// CPU 线程上的 PPU 寄存器（$2000-$3FFF，每 8 字节镜像一次）。
+// 只维护 CPU 读得到或影响 CPU 的状态: $2002 的 vblank 位（读后清零）、$2000 的 NMI 使能；
+// $2000/$2001 的写入记进 VideoPipeline 的日志，由渲染线程重放（显存页的写入由 VideoPipeline
+// 自己挂在总线上记录）；$2002 的读取不记日志。
+// 还没有图块渲染，不模拟 VRAM（$2006/$2007）和精灵 0 命中
+class PpuRegisters : public BusDevice {
+public:
+    struct State
+    {
+        uint8_t ctrl = 0;
+        uint8_t mask = 0;
+        uint8_t status = 0;
+    };
+
+    static constexpr uint8_t CTRL_NMI = 0x80;
+    static constexpr uint8_t STATUS_VBLANK = 0x80;
+
+    explicit PpuRegisters() = default;
+
+    PpuRegisters(const PpuRegisters&) = delete;
+    void operator=(const PpuRegisters&) = delete;
+
+    void attach(Bus& bus);
+    void detach(Bus& bus);
+    void setLog(VideoPipeline* log) { pipeline = log; }
+
+    void setVblank(bool on) {
+        state.status = static_cast<uint8_t>(on ? state.status | STATUS_VBLANK : state.status & ~STATUS_VBLANK);
+    }
+    bool nmiEnabled() const { return (state.ctrl & CTRL_NMI) != 0; }
+    uint8_t mask() const { return state.mask; }
+
+    uint8_t ioRead(uint16_t address, uint8_t data) override;
+    void ioWrite(uint16_t address, uint8_t data) override;
+
+    State saveState() const { return state; }
+    void loadState(const State& s) { state = s; }
+    void reset() { state = State{}; }
+
+private:
+    VideoPipeline* pipeline = nullptr;
+    State state;
+};
+}
+
+#endif // !PPU_H
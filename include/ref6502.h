@@ -0,0 +1,67 @@
+﻿#ifndef REF6502_H
+#define REF6502_H
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace nes {
+
+// 参考用的 6502 实现，只用于和 OLC6502 做对拍。
+// 刻意写得简单直白: 一个 switch 处理全部官方指令，自带 64K 内存，
+// 不追求速度，只追求容易核对。和 2A03 一样不实现十进制模式。
+class Ref6502 {
+public:
+    struct Write
+    {
+        uint16_t address = 0x0000;
+        uint8_t data = 0x00;
+
+        bool operator==(const Write&) const = default;
+    };
+
+    // 执行一条指令，返回消耗的周期数；遇到非官方指令返回 0 且不执行
+    int step();
+
+    uint8_t  a = 0x00;
+    uint8_t  x = 0x00;
+    uint8_t  y = 0x00;
+    uint8_t  sp = 0x00;
+    uint16_t pc = 0x0000;
+    uint8_t  status = 0x00;
+
+    std::array<uint8_t, 64 * 1024> mem {};
+    std::vector<Write> writes;      // 上一条指令产生的写操作
+
+private:
+    uint8_t read(uint16_t address) const { return mem[address]; }
+    void write(uint16_t address, uint8_t data);
+    uint16_t word(uint16_t address) const;
+
+    void push(uint8_t data);
+    uint8_t pull();
+    void setZN(uint8_t v);
+    void setFlag(uint8_t flag, bool v);
+    bool flag(uint8_t f) const { return (status & f) != 0; }
+
+    uint16_t imm();
+    uint16_t zp();
+    uint16_t zpx();
+    uint16_t zpy();
+    uint16_t abs();
+    uint16_t abx(bool& crossed);
+    uint16_t aby(bool& crossed);
+    uint16_t izx();
+    uint16_t izy(bool& crossed);
+
+    int branch(bool taken);
+    void adc(uint8_t v);
+    void compare(uint8_t reg, uint8_t v);
+    uint8_t asl(uint8_t v);
+    uint8_t lsr(uint8_t v);
+    uint8_t rol(uint8_t v);
+    uint8_t ror(uint8_t v);
+};
+}
+
+#endif // !REF6502_H
@@ -0,0 +1,69 @@
+﻿#ifndef ROM_DISASM_H
+#define ROM_DISASM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace nes {
+
+// 整个 ROM 按 PRG bank 并行反汇编的异步任务。
+// 输出是预先分配好的扁平数组，每个 PRG 字节一个槽位，各线程只写自己那个 bank 的区间；
+// 每个 bank 完成后置位，使用者可以边算边显示（nes_disasm 就是按 bank 顺序边算边输出）。
+// 包含复位向量的固定 bank 最先处理
+class RomDisassembly {
+public:
+    static constexpr size_t BANK_SIZE = 16 * 1024;
+
+    struct Line
+    {
+        uint32_t offset;    // 在 PRG 里的偏移
+        uint16_t address;   // 映射到的 CPU 地址
+        uint8_t length;     // 0 表示这个字节属于前面的指令
+        uint8_t code;       // 1: 指令，0: 数据
+        char text[32];
+    };
+
+    explicit RomDisassembly() = default;
+    ~RomDisassembly();
+
+    RomDisassembly(const RomDisassembly&) = delete;
+    void operator=(const RomDisassembly&) = delete;
+
+    // 读入 .nes（可选 FCEUX .cdl），分配输出；cdlPath 为空表示没有
+    bool open(const std::string& romPath, const std::string& cdlPath, std::string& error);
+
+    // 在后台线程上开始，threads 为 0 时用全部核
+    void start(unsigned threads = 0);
+    void cancel();
+    void wait();
+
+    size_t bankCount() const { return banks; }
+    uint16_t bankBase(size_t bank) const;
+
+    bool bankReady(size_t bank) const { return ready[bank].load(std::memory_order_acquire) != 0; }
+    size_t banksReady() const { return done.load(std::memory_order_acquire); }
+    bool finished() const { return banksReady() == banks; }
+
+    // 某个 bank 的 BANK_SIZE 个槽位，bankReady 之后才能读
+    const Line* bank(size_t bank) const { return lines.get() + bank * BANK_SIZE; }
+
+private:
+    void disassembleBank(size_t bank);
+
+    std::vector<uint8_t> prg;
+    std::vector<uint8_t> cdl;
+    size_t banks = 0;
+    std::unique_ptr<Line[]> lines;
+    std::unique_ptr<std::atomic<uint8_t>[]> ready;
+    std::atomic<size_t> done{ 0 };
+    std::atomic<bool> cancelled{ false };
+    std::thread job;
+};
+}
+
+#endif // !ROM_DISASM_H
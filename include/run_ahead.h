@@ -0,0 +1,54 @@
+﻿#ifndef RUN_AHEAD_H
+#define RUN_AHEAD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "machine.h"
+
+namespace nes {
+
+// 预测执行（run-ahead），抵消游戏自身的输入延迟: 每帧先不出画面地跑真实的一帧，
+// 存增量检查点，再用当前输入往前跑 frames 帧、只渲染最后一帧给 FrameSink，然后恢复检查点。
+// 屏幕上看到的总是 frames 帧之后的画面，而机器状态始终停在真实的这一帧
+class RunAhead {
+public:
+    // 每帧各阶段的平均耗时（微秒），每 WINDOW 帧更新一次
+    struct Metrics
+    {
+        double save = 0.0;
+        double restore = 0.0;
+        double emulate = 0.0;   // 真实的一帧加上预测的各帧
+        double total = 0.0;
+        uint32_t frames = 0;    // 统计窗口内的帧数
+    };
+
+    static constexpr uint32_t MAX_FRAMES = 8;
+    static constexpr uint32_t WINDOW = 60;
+
+    explicit RunAhead(Machine& machine, uint32_t frames = 1);
+    ~RunAhead() = default;
+
+    RunAhead(const RunAhead&) = delete;
+    void operator=(const RunAhead&) = delete;
+
+    // 0 表示关闭，这时 runFrame 就是普通地跑一帧
+    void setFrames(uint32_t frames);
+    uint32_t frames() const { return ahead; }
+
+    void runFrame();
+
+    const Metrics& metrics() const { return published; }
+
+private:
+    Machine& machine;
+    uint32_t ahead;
+    std::unique_ptr<Machine::Checkpoint> checkpoint = std::make_unique<Machine::Checkpoint>();
+
+    Metrics sum;
+    Metrics published;
+};
+}
+
+#endif // !RUN_AHEAD_H
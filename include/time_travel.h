@@ -0,0 +1,93 @@
+﻿#ifndef TIME_TRAVEL_H
+#define TIME_TRAVEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "debugger.h"
+#include "machine.h"
+
+namespace nes {
+
+// 反向调试: 正向执行时按间隔保存快照，反向时恢复最近的快照再确定性地重放到目标周期。
+// 快照间隔按实测的执行速度自适应，保证一次反向单步的重放量在时间预算之内；
+// 快照太多时把较旧的一半隔一个删一个，越旧越稀疏，总内存有上限。
+// 复位/IRQ/NMI 这些外部事件按周期记录下来，重放时在同一个周期再注入
+class TimeTravel {
+public:
+    explicit TimeTravel(Machine& machine, Debugger& debugger, double stepBudget = 0.05, size_t maxSnapshots = 512);
+    ~TimeTravel() = default;
+
+    TimeTravel(const TimeTravel&) = delete;
+    void operator=(const TimeTravel&) = delete;
+
+    // 正向执行，必须经过这里才能记录历史
+    Debugger::Stop step();
+    Debugger::Stop run(uint64_t cycles);
+
+    void reset();
+    void irq();
+    void nmi();
+
+    // 回到上一条指令开始执行前的状态，已经在历史起点时返回 false
+    bool reverseStep();
+
+    // 回到当前位置之前最近一次命中断点/观察点的位置；没有命中时停在历史起点
+    Debugger::Stop reverseContinue();
+
+    // 丢掉全部历史，从当前状态重新开始记录（比如装入了新程序）
+    void clear();
+
+    size_t snapshotCount() const { return snapshots.size(); }
+    uint64_t snapshotInterval() const { return interval; }
+
+private:
+    enum class Event : uint8_t { RESET, IRQ, NMI };
+
+    struct Point
+    {
+        uint64_t cycle;
+        std::unique_ptr<Machine::Snapshot> state;
+    };
+
+    struct Record
+    {
+        uint64_t cycle;
+        Event event;
+    };
+
+    uint64_t now() const { return machine.cycleCount(); }
+
+    void inject(Event event);
+    void apply(Event event);
+    void applyEvents();
+    uint64_t nextEventCycle() const;
+
+    void stepOnce();
+    void forwardTo(uint64_t target);
+    Debugger::Stop runUntil(uint64_t limit);
+    Debugger::Stop replay(uint64_t limit);
+
+    void takeSnapshot();
+    void maybeSnapshot();
+    void thin();
+    size_t latestBefore(uint64_t cycle) const;
+    void restore(size_t index);
+    void truncateAfter(uint64_t cycle);
+
+    Machine& machine;
+    Debugger& debugger;
+    double step_budget;
+    size_t max_snapshots;
+    uint64_t interval = 100000;
+
+    std::vector<Point> snapshots;
+    std::vector<std::unique_ptr<Machine::Snapshot>> spare;
+    std::vector<Record> events;
+    size_t event_cursor = 0;
+};
+}
+
+#endif // !TIME_TRAVEL_H
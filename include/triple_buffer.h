@@ -0,0 +1,47 @@
+﻿#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace nes {
+
+// 单生产者/单消费者的无锁三缓冲: 生产者写 back() 后 publish()，消费者 latest() 拿最新发布的一份。
+// 两边各自独占一个槽位，中间槽位靠一次原子交换转手，谁都不会等谁；
+// 消费者跟不上时旧数据直接被覆盖，只保证看到的是完整的一份
+template <typename T>
+class TripleBuffer {
+public:
+    explicit TripleBuffer() = default;
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    void operator=(const TripleBuffer&) = delete;
+
+    // 生产者线程
+    T& back() { return slots[back_index]; }
+
+    void publish() {
+        back_index = middle.exchange(static_cast<uint8_t>(back_index | FRESH), std::memory_order_acq_rel) & INDEX;
+    }
+
+    // 消费者线程；没有新发布的数据时返回上一份
+    const T& latest() {
+        if (middle.load(std::memory_order_relaxed) & FRESH) {
+            front_index = middle.exchange(front_index, std::memory_order_acq_rel) & INDEX;
+        }
+        return slots[front_index];
+    }
+
+private:
+    static constexpr uint8_t INDEX = 0x03;
+    static constexpr uint8_t FRESH = 0x04;
+
+    std::array<T, 3> slots{};
+    uint8_t back_index = 0;
+    std::atomic<uint8_t> middle{ 1 };
+    uint8_t front_index = 2;
+};
+}
+
+#endif // !TRIPLE_BUFFER_H
@@ -0,0 +1,96 @@
+﻿#ifndef VEC_ENV_H
+#define VEC_ENV_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "machine.h"
+#include "parallel.h"
+
+namespace nes {
+
+// 从 RAM 计算奖励: 每帧取 address 开始的 bytes 个字节（小端或 BCD），
+// 奖励是 scale * (本帧值 - 上帧值)
+struct RewardSpec
+{
+    uint16_t address = 0x0000;
+    uint8_t bytes = 1;
+    bool bcd = false;
+    float scale = 1.0f;
+};
+
+struct VecEnvConfig
+{
+    std::string program;
+    uint16_t loadAddress = 0x8000;
+
+    // 启动后先跑这么多帧再存起始状态，之后每次 reset 都从这个状态恢复
+    uint32_t warmupFrames = 0;
+
+    // 每个 step 运行的帧数；动作只在前 actionRepeat 帧里保持，之后松开（写 0）
+    uint32_t frameskip = 4;
+    uint32_t actionRepeat = 4;
+
+    // 每帧开始前把动作字节写到这里
+    uint16_t inputAddress = 0x00FF;
+    // 为 true 时动作字节是 1P 手柄的按键（Button 位），由游戏读 $4016 取走，不再写 inputAddress
+    bool controllerInput = false;
+
+    // 观测: 这些地址的 RAM 字节，按顺序排列；为空时取整个 $0000-$07FF
+    std::vector<uint16_t> observeAddresses;
+
+    std::vector<RewardSpec> rewards;
+
+    // 这个地址的值等于 doneValue 时本局结束并自动 reset
+    bool useDone = false;
+    uint16_t doneAddress = 0x0000;
+    uint8_t doneValue = 0x00;
+};
+
+// N 个模拟器实例组成的向量化环境。
+// 所有输出都写进调用者提供的连续缓冲区，step 在常驻线程池上并行
+class VecEnv {
+public:
+    explicit VecEnv(const VecEnvConfig& config, size_t count, unsigned threads = 0);
+    ~VecEnv() = default;
+
+    VecEnv(const VecEnv&) = delete;
+    void operator=(const VecEnv&) = delete;
+
+    bool ok() const { return error.empty(); }
+    const std::string& lastError() const { return error; }
+
+    size_t size() const { return envs.size(); }
+    size_t observationSize() const { return observeAddresses.size(); }
+
+    // observations: size() * observationSize() 字节
+    void reset(uint8_t* observations);
+
+    // actions: size() 字节；rewards: size() 个；dones: size() 字节，可为 nullptr
+    void step(const uint8_t* actions, uint8_t* observations, float* rewards, uint8_t* dones);
+
+private:
+    struct Env
+    {
+        Machine m;
+        std::vector<int64_t> lastReward;
+    };
+
+    void resetEnv(Env& env);
+    void observe(const Env& env, uint8_t* out) const;
+    float collectReward(Env& env) const;
+    int64_t readValue(const Env& env, const RewardSpec& spec) const;
+
+    VecEnvConfig config;
+    std::vector<uint16_t> observeAddresses;
+    std::unique_ptr<Machine::Snapshot> start;
+    std::vector<std::unique_ptr<Env>> envs;
+    ThreadPool pool;
+    std::string error;
+};
+}
+
+#endif // !VEC_ENV_H
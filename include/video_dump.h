@@ -0,0 +1,85 @@
+﻿#ifndef VIDEO_DUMP_H
+#define VIDEO_DUMP_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace nes {
+
+// 2C02 调色板，RGBA 字节序（与 olc::Pixel 相同）
+extern const std::array<uint32_t, 64> PALETTE_2C02;
+
+// 无界面视频输出：模拟线程只负责把帧拷贝进有界无锁队列，
+// 写盘/写管道和颜色转换全部在写线程完成，队列满时丢帧并计数
+class VideoDump {
+public:
+    enum class Format : uint8_t
+    {
+        RAW_RGB,    // 连续的 RGB24 帧，无文件头
+        Y4M,        // YUV4MPEG2, C444
+    };
+
+    explicit VideoDump(uint32_t width, uint32_t height, Format format,
+        uint32_t queueDepth = 8, uint32_t fps = 60);
+    ~VideoDump();
+
+    VideoDump(const VideoDump&) = delete;
+    void operator=(const VideoDump&) = delete;
+
+    // path 为 "-" 时写到 stdout，方便直接接 ffmpeg 等编码器
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return out != nullptr; }
+
+    // 提交一帧，返回 false 表示队列已满、该帧被丢弃
+    bool submitRGBA(const uint32_t* pixels);
+    bool submitIndexed(const uint8_t* indices);
+
+    // 在模拟线程上调用，之后提交的下标帧用新的调色板，已经在队列里的帧不受影响
+    void setPalette(const std::array<uint32_t, 64>& pal) { palette = pal; }
+
+    uint64_t framesWritten() const { return written.load(std::memory_order_relaxed); }
+    uint64_t framesDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    enum class Kind : uint8_t { RGBA, INDEXED };
+
+    struct Slot
+    {
+        Kind kind = Kind::RGBA;
+        std::vector<uint8_t> data;
+        std::array<uint32_t, 64> palette;   // 下标帧提交时的调色板，写线程只读这份
+    };
+
+    Slot* acquire();
+    void publish();
+    void writerLoop();
+    void writeFrame(const Slot& slot);
+
+    const uint32_t width;
+    const uint32_t height;
+    const Format format;
+    const uint32_t fps;
+
+    std::vector<Slot> slots;
+    std::atomic<uint64_t> head { 0 };       // 写线程已消费的帧数
+    std::atomic<uint64_t> tail { 0 };       // 模拟线程已提交的帧数
+    std::atomic<uint32_t> signal { 0 };     // 唤醒写线程用
+    std::atomic<bool> stopping { false };
+
+    std::atomic<uint64_t> written { 0 };
+    std::atomic<uint64_t> dropped { 0 };
+
+    std::array<uint32_t, 64> palette = PALETTE_2C02;   // 只在模拟线程上用
+    std::vector<uint8_t> line;              // 写线程的转换缓冲
+    std::FILE* out = nullptr;
+    std::thread writer;
+};
+}
+
+#endif // !VIDEO_DUMP_H
@@ -0,0 +1,90 @@
+﻿#ifndef VIDEO_PIPELINE_H
+#define VIDEO_PIPELINE_H
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bus.h"
+
+namespace nes {
+
+class FrameSink;
+class OLC6502;
+
+// 流水线渲染: CPU 线程只把影响画面的写操作（显存 $0200-$05FF 和 PPU 寄存器）连同帧内周期
+// 追加进这一帧的日志，帧尾把日志交给渲染线程；渲染线程按顺序重放到自己的显存副本上再出画面，
+// 比 CPU 晚一帧。日志按帧依次处理、不丢帧，渲染线程落后 QUEUE_FRAMES 帧时 CPU 线程等它，
+// 所以输出和同步渲染逐帧一致
+class VideoPipeline : public BusDevice {
+public:
+    static constexpr size_t QUEUE_FRAMES = 2;
+
+    struct Write
+    {
+        uint32_t cycle;     // 从帧开始算的 CPU 周期
+        uint16_t address;
+        uint8_t data;
+    };
+
+    explicit VideoPipeline(const OLC6502& cpu);
+    ~VideoPipeline();
+
+    VideoPipeline(const VideoPipeline&) = delete;
+    void operator=(const VideoPipeline&) = delete;
+
+    // 挂到显存所在的页上，之后的写入都会记日志
+    void attach(Bus& bus);
+    void detach(Bus& bus);
+
+    // 以下都在 CPU 线程上调用
+    void record(uint16_t address, uint8_t data);
+
+    // 恢复快照或绕过总线改了显存之后，用整块显存和当前的 $2001 重新同步渲染线程的副本
+    void resync(const uint8_t* ram, uint8_t ppuMask);
+
+    // 结束这一帧: sink 不为 nullptr 时渲染线程重放完这一帧后把画面交给它（在渲染线程上调用）
+    void endFrame(FrameSink* sink);
+
+    // 等渲染线程处理完已经交出去的所有帧
+    void flush();
+
+    uint8_t ioRead(uint16_t address, uint8_t data) override { (void)address; return data; }
+    void ioWrite(uint16_t address, uint8_t data) override { record(address, data); }
+
+private:
+    struct Frame
+    {
+        std::vector<Write> writes;
+        FrameSink* sink = nullptr;
+    };
+
+    void renderLoop();
+
+    const OLC6502& cpu;
+    uint64_t frame_start = 0;
+    Frame current;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable drained;
+    std::deque<Frame> queue;
+    std::vector<std::vector<Write>> spare;     // 用过的日志缓冲，避免每帧分配
+    bool rendering = false;
+    bool stopping = false;
+
+    // 只在渲染线程上用
+    std::array<uint8_t, 32 * 32> screen{};
+    uint8_t mask = 0;
+    std::array<uint32_t, 32 * 32> framebuffer{};
+
+    std::thread worker;
+};
+}
+
+#endif // !VIDEO_PIPELINE_H
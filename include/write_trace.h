@@ -0,0 +1,93 @@
+﻿#ifndef WRITE_TRACE_H
+#define WRITE_TRACE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bus.h"
+#include "machine.h"
+
+namespace nes {
+
+// 写操作的执行轨迹，用来回答"最后是谁写了这个地址"。
+// 记录按块追加保存，每块带一张 64K 位的地址位图，查询时先用位图跳过无关的块；
+// 内存里只保留最近的若干块，更早的块写进临时文件，通过内存映射读取。
+// 机器恢复状态时立刻丢掉恢复点之后的旧记录（没在记录时恢复过的，下次 start 时补上），
+// 所以回退、回滚之后轨迹始终是当前时间线的
+class WriteTrace : public BusObserver {
+public:
+    struct Record
+    {
+        uint64_t cycle;     // 指令开始的周期
+        uint16_t pc;        // 指令地址
+        uint16_t address;
+        uint8_t value;
+        uint8_t reserved[3];
+    };
+
+    static constexpr size_t CHUNK_RECORDS = 64 * 1024;
+
+    // memoryChunks: 内存里最多保留的块数；spillPath 为空时在临时目录建文件
+    explicit WriteTrace(Machine& machine, size_t memoryChunks = 64, const std::string& spillPath = "");
+    ~WriteTrace() override;
+
+    WriteTrace(const WriteTrace&) = delete;
+    void operator=(const WriteTrace&) = delete;
+
+    // 挂到总线上开始/停止记录
+    void start();
+    void stop();
+    bool recording() const { return machine.bus->tracer == this; }
+
+    void clear();
+
+    // 丢掉周期 >= cycle 的记录
+    void truncate(uint64_t cycle);
+
+    uint64_t size() const { return total; }
+    size_t chunkCount() const { return chunks.size(); }
+    size_t spilledChunks() const { return spilled; }
+
+    // 最近写过 address 的 n 条记录，新的在前
+    std::vector<Record> lastWriters(uint16_t address, size_t n) const;
+
+    // 周期在 [first, last] 之间的写操作，按时间顺序，最多 limit 条
+    std::vector<Record> writesInRange(uint64_t first, uint64_t last,
+        size_t limit = std::numeric_limits<size_t>::max()) const;
+
+    void onWrite(uint16_t address, uint8_t data) override;
+    void onRestore(uint64_t cycle) override;
+
+private:
+    struct Chunk
+    {
+        uint64_t first_cycle = 0;
+        uint64_t last_cycle = 0;
+        size_t count = 0;
+        std::unique_ptr<Record[]> records;  // 溢出到文件后为空
+        uint64_t file_offset = 0;
+        std::array<uint64_t, 1024> addresses{};
+    };
+
+    class SpillFile;
+
+    const Record* recordsOf(const Chunk& chunk) const;
+    void spillOldest();
+
+    Machine& machine;
+    size_t memory_chunks;
+    std::string spill_path;
+    std::unique_ptr<SpillFile> file;
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    size_t spilled = 0;
+    uint64_t total = 0;
+    uint64_t restore_seen = 0;
+};
+}
+
+#endif // !WRITE_TRACE_H
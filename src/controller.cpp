@@ -0,0 +1,93 @@
+﻿#include "controller.h"
+
+#include <chrono>
+
+namespace nes {
+void InputState::set(size_t port, uint8_t buttons)
+{
+    update(port, buttons, 0xFF);
+}
+
+void InputState::press(size_t port, uint8_t mask)
+{
+    update(port, mask, 0x00);
+}
+
+void InputState::release(size_t port, uint8_t mask)
+{
+    update(port, 0x00, mask);
+}
+
+uint64_t InputState::now()
+{
+    const auto t = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t).count()) & STAMP_MASK;
+}
+
+// 先清 clear 再置 set；按键没变时不动时间戳，自动重复的按下事件不算新的输入
+void InputState::update(size_t port, uint8_t set, uint8_t clear)
+{
+    std::atomic<uint64_t>& p = ports[port];
+    uint64_t old = p.load(std::memory_order_relaxed);
+    uint64_t next;
+    do {
+        const uint8_t pressed = static_cast<uint8_t>((buttons(old) & ~clear) | set);
+        if (pressed == buttons(old)) {
+            return;
+        }
+        next = (now() << 8) | pressed;
+    } while (!p.compare_exchange_weak(old, next, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void Controllers::attach(Bus& bus)
+{
+    bus.attachDevice(0x40, this);
+}
+
+void Controllers::detach(Bus& bus)
+{
+    bus.attachDevice(0x40, nullptr);
+}
+
+void Controllers::latch()
+{
+    for (size_t port = 0; port < InputState::PORTS; port++) {
+        if (input != nullptr) {
+            const uint64_t sample = input->sample(port);
+            state.shift[port] = InputState::buttons(sample);
+            latched_stamp[port] = InputState::stamp(sample);
+        }
+        else {
+            state.shift[port] = fixed[port];
+        }
+    }
+}
+
+uint8_t Controllers::ioRead(uint16_t address, uint8_t data)
+{
+    if (address != 0x4016 && address != 0x4017) {
+        return data;
+    }
+    // 选通为高时读到的总是当前的 A 键
+    if (state.strobe) {
+        latch();
+    }
+    uint8_t& shift = state.shift[address - 0x4016];
+    const uint8_t bit = shift & 0x01;
+    shift = static_cast<uint8_t>((shift >> 1) | 0x80);
+    // 高 3 位是开路总线，通常读出 $40
+    return static_cast<uint8_t>(0x40 | bit);
+}
+
+void Controllers::ioWrite(uint16_t address, uint8_t data)
+{
+    if (address != 0x4016) {
+        return;
+    }
+    const uint8_t strobe = data & 0x01;
+    if (strobe || state.strobe) {
+        latch();
+    }
+    state.strobe = strobe;
+}
+}
@@ -0,0 +1,437 @@
+﻿#include "debugger.h"
+
+#include <algorithm>
+#include <cctype>
+
+namespace nes {
+
+// 递归下降，按优先级从低到高: || && | ^ & 比较 移位 加减 乘 一元
+struct Condition::Parser
+{
+    Parser(const std::string& text, std::vector<Insn>& code) : text(text), code(code) {}
+
+    const std::string& text;
+    size_t pos = 0;
+    std::vector<Insn>& code;
+    std::string error;
+    size_t depth = 0;
+    size_t maxDepth = 0;
+
+    void skipSpace() {
+        while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) {
+            pos++;
+        }
+    }
+
+    bool accept(const char* token) {
+        skipSpace();
+        const size_t n = std::char_traits<char>::length(token);
+        if (text.compare(pos, n, token) != 0) {
+            return false;
+        }
+        // "<" 不能吃掉 "<=" 或 "<<"，"&" 不能吃掉 "&&"，以此类推
+        if (n == 1 && pos + 1 < text.size()) {
+            const char next = text[pos + 1];
+            const char c = token[0];
+            if ((c == '<' || c == '>') && (next == '=' || next == c)) {
+                return false;
+            }
+            if ((c == '&' || c == '|') && next == c) {
+                return false;
+            }
+            if (c == '!' && next == '=') {
+                return false;
+            }
+        }
+        pos += n;
+        return true;
+    }
+
+    void emit(Op op, int32_t imm = 0) {
+        code.push_back({ op, imm });
+        if (op <= LOAD) {
+            // 压栈类指令（LOAD 先弹后压，深度不变）
+            if (op != LOAD) {
+                depth++;
+                maxDepth = std::max(maxDepth, depth);
+            }
+        }
+        else if (op >= MUL) {
+            depth--;
+        }
+    }
+
+    bool fail(const std::string& message) {
+        if (error.empty()) {
+            error = message + " at column " + std::to_string(pos + 1);
+        }
+        return false;
+    }
+
+    bool number() {
+        skipSpace();
+        int base = 10;
+        if (accept("$")) {
+            base = 16;
+        }
+        else if (text.compare(pos, 2, "0x") == 0 || text.compare(pos, 2, "0X") == 0) {
+            base = 16;
+            pos += 2;
+        }
+        const size_t begin = pos;
+        int64_t v = 0;
+        while (pos < text.size() && std::isxdigit(static_cast<unsigned char>(text[pos]))) {
+            const char c = static_cast<char>(std::toupper(static_cast<unsigned char>(text[pos])));
+            const int d = c <= '9' ? c - '0' : c - 'A' + 10;
+            if (d >= base) {
+                break;
+            }
+            v = v * base + d;
+            if (v > 0x7FFFFFFF) {
+                return fail("number too large");
+            }
+            pos++;
+        }
+        if (pos == begin) {
+            return fail("expected number");
+        }
+        emit(PUSH, static_cast<int32_t>(v));
+        return true;
+    }
+
+    bool primary() {
+        skipSpace();
+        if (pos >= text.size()) {
+            return fail("unexpected end of expression");
+        }
+        if (accept("(")) {
+            if (!expression()) {
+                return false;
+            }
+            return accept(")") || fail("expected ')'");
+        }
+        if (accept("[")) {
+            if (!expression()) {
+                return false;
+            }
+            emit(LOAD);
+            return accept("]") || fail("expected ']'");
+        }
+        if (std::isalpha(static_cast<unsigned char>(text[pos]))) {
+            const size_t begin = pos;
+            while (pos < text.size() && std::isalnum(static_cast<unsigned char>(text[pos]))) {
+                pos++;
+            }
+            std::string name = text.substr(begin, pos - begin);
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+            static const std::unordered_map<std::string, Op> names = {
+                { "A", REG_A }, { "X", REG_X }, { "Y", REG_Y }, { "SP", REG_SP }, { "PC", REG_PC },
+                { "P", REG_P }, { "VALUE", VALUE }, { "ADDR", ADDR },
+            };
+            const auto it = names.find(name);
+            if (it == names.end()) {
+                // 0x 前缀以外的十六进制必须写 $，所以这里不是数字
+                pos = begin;
+                return fail("unknown name '" + name + "'");
+            }
+            emit(it->second);
+            return true;
+        }
+        return number();
+    }
+
+    bool unary() {
+        if (accept("!")) {
+            if (!unary()) return false;
+            emit(NOT);
+            return true;
+        }
+        if (accept("-")) {
+            if (!unary()) return false;
+            emit(NEG);
+            return true;
+        }
+        if (accept("~")) {
+            if (!unary()) return false;
+            emit(BNOT);
+            return true;
+        }
+        return primary();
+    }
+
+    struct Level
+    {
+        const char* token;
+        Op op;
+    };
+
+    // 同一优先级的左结合二元运算
+    template <typename Next>
+    bool binary(std::initializer_list<Level> levels, Next next) {
+        if (!(this->*next)()) {
+            return false;
+        }
+        for (;;) {
+            const Level* matched = nullptr;
+            for (const auto& l : levels) {
+                if (accept(l.token)) {
+                    matched = &l;
+                    break;
+                }
+            }
+            if (matched == nullptr) {
+                return true;
+            }
+            if (!(this->*next)()) {
+                return false;
+            }
+            emit(matched->op);
+        }
+    }
+
+    bool multiplicative() { return binary({ { "*", MUL } }, &Parser::unary); }
+    bool additive() { return binary({ { "+", ADD }, { "-", SUB } }, &Parser::multiplicative); }
+    bool shift() { return binary({ { "<<", SHL }, { ">>", SHR } }, &Parser::additive); }
+    bool relational() { return binary({ { "<=", LE }, { ">=", GE }, { "<", LT }, { ">", GT } }, &Parser::shift); }
+    bool equality() { return binary({ { "==", EQ }, { "!=", NE } }, &Parser::relational); }
+    bool bitAnd() { return binary({ { "&", AND } }, &Parser::equality); }
+    bool bitXor() { return binary({ { "^", XOR } }, &Parser::bitAnd); }
+    bool bitOr() { return binary({ { "|", OR } }, &Parser::bitXor); }
+    bool logicalAnd() { return binary({ { "&&", LAND } }, &Parser::bitOr); }
+    bool expression() { return binary({ { "||", LOR } }, &Parser::logicalAnd); }
+};
+
+bool Condition::compile(const std::string& text, std::string& error)
+{
+    code.clear();
+    source = text;
+
+    std::vector<Insn> out;
+    Parser parser(text, out);
+    parser.skipSpace();
+    if (parser.pos == text.size()) {
+        return true;
+    }
+    bool ok = parser.expression();
+    parser.skipSpace();
+    if (ok && parser.pos != text.size()) {
+        ok = parser.fail("unexpected character");
+    }
+    if (ok && parser.maxDepth > MAX_STACK) {
+        ok = parser.fail("expression too deep");
+    }
+    if (!ok) {
+        error = parser.error;
+        source.clear();
+        return false;
+    }
+    code = std::move(out);
+    return true;
+}
+
+int32_t Condition::evaluate(const Machine& machine, uint16_t address, uint8_t value) const
+{
+    int32_t stack[MAX_STACK];
+    size_t sp = 0;
+    const OLC6502& cpu = machine.cpu;
+    const auto& ram = machine.bus->ram;
+
+    for (const Insn& insn : code) {
+        switch (insn.op) {
+        case PUSH: stack[sp++] = insn.imm; break;
+        case REG_A: stack[sp++] = cpu.a; break;
+        case REG_X: stack[sp++] = cpu.x; break;
+        case REG_Y: stack[sp++] = cpu.y; break;
+        case REG_SP: stack[sp++] = cpu.sp; break;
+        case REG_PC: stack[sp++] = cpu.pc; break;
+        case REG_P: stack[sp++] = cpu.status; break;
+        case VALUE: stack[sp++] = value; break;
+        case ADDR: stack[sp++] = address; break;
+        case LOAD: stack[sp - 1] = ram[static_cast<uint16_t>(stack[sp - 1])]; break;
+        case NEG: stack[sp - 1] = -stack[sp - 1]; break;
+        case NOT: stack[sp - 1] = !stack[sp - 1]; break;
+        case BNOT: stack[sp - 1] = ~stack[sp - 1]; break;
+        default:
+        {
+            const int32_t r = stack[--sp];
+            int32_t& l = stack[sp - 1];
+            switch (insn.op) {
+            case MUL: l = l * r; break;
+            case ADD: l = l + r; break;
+            case SUB: l = l - r; break;
+            case SHL: l = static_cast<int32_t>(static_cast<uint32_t>(l) << (r & 31)); break;
+            case SHR: l = static_cast<int32_t>(static_cast<uint32_t>(l) >> (r & 31)); break;
+            case AND: l = l & r; break;
+            case XOR: l = l ^ r; break;
+            case OR: l = l | r; break;
+            case EQ: l = l == r; break;
+            case NE: l = l != r; break;
+            case LT: l = l < r; break;
+            case LE: l = l <= r; break;
+            case GT: l = l > r; break;
+            case GE: l = l >= r; break;
+            case LAND: l = l && r; break;
+            case LOR: l = l || r; break;
+            default: break;
+            }
+            break;
+        }
+        }
+    }
+    return sp > 0 ? stack[sp - 1] : 1;
+}
+
+Debugger::Debugger(Machine& machine)
+    : machine(machine)
+{
+    machine.bus->observer = this;
+}
+
+Debugger::~Debugger()
+{
+    if (machine.bus->observer == this) {
+        machine.bus->observer = nullptr;
+        machine.bus->setAllPageTraps(0);
+    }
+}
+
+bool Debugger::setBreakpoint(uint16_t address, const std::string& condition, std::string& error)
+{
+    Condition c;
+    if (!c.compile(condition, error)) {
+        return false;
+    }
+    if (!hasBreakpoint(address)) {
+        exec_bits[address >> 6] |= 1ULL << (address & 63);
+        exec_count++;
+    }
+    if (c.empty()) {
+        conditions.erase(address);
+    }
+    else {
+        conditions[address] = std::move(c);
+    }
+    return true;
+}
+
+void Debugger::clearBreakpoint(uint16_t address)
+{
+    if (hasBreakpoint(address)) {
+        exec_bits[address >> 6] &= ~(1ULL << (address & 63));
+        exec_count--;
+    }
+    conditions.erase(address);
+}
+
+void Debugger::clearBreakpoints()
+{
+    exec_bits.fill(0);
+    exec_count = 0;
+    conditions.clear();
+}
+
+bool Debugger::toggleBreakpoint(uint16_t address)
+{
+    if (hasBreakpoint(address)) {
+        clearBreakpoint(address);
+        return false;
+    }
+    std::string error;
+    return setBreakpoint(address, "", error);
+}
+
+bool Debugger::setWatchpoint(uint16_t address, uint16_t length, uint8_t access, const std::string& condition, std::string& error)
+{
+    access &= Bus::TRAP_READ | Bus::TRAP_WRITE;
+    if (length == 0 || access == 0) {
+        error = "empty watchpoint";
+        return false;
+    }
+    Watch w{ address, std::min<uint32_t>(static_cast<uint32_t>(address) + length, 0x10000), access, {} };
+    if (!w.condition.compile(condition, error)) {
+        return false;
+    }
+    watches.push_back(std::move(w));
+    updatePageTraps();
+    return true;
+}
+
+void Debugger::clearWatchpoints()
+{
+    watches.clear();
+    updatePageTraps();
+}
+
+void Debugger::updatePageTraps()
+{
+    std::array<uint8_t, 256> traps{};
+    for (const auto& w : watches) {
+        for (uint32_t page = w.address >> 8; page <= (w.end - 1) >> 8; page++) {
+            traps[page] |= w.access;
+        }
+    }
+    for (size_t page = 0; page < traps.size(); page++) {
+        machine.bus->setPageTrap(static_cast<uint8_t>(page), traps[page]);
+    }
+}
+
+void Debugger::check(Stop reason, uint8_t access, uint16_t address, uint8_t data)
+{
+    if (pending.reason != Stop::NONE) {
+        return;
+    }
+    for (const auto& w : watches) {
+        if ((w.access & access) && address >= w.address && address < w.end
+            && (w.condition.empty() || w.condition.evaluate(machine, address, data) != 0)) {
+            pending = { reason, address, data };
+            return;
+        }
+    }
+}
+
+void Debugger::onWrite(uint16_t address, uint8_t data)
+{
+    check(Stop::WATCH_WRITE, Bus::TRAP_WRITE, address, data);
+}
+
+void Debugger::onRead(uint16_t address, uint8_t data)
+{
+    check(Stop::WATCH_READ, Bus::TRAP_READ, address, data);
+}
+
+bool Debugger::breakAt(uint16_t pc) const
+{
+    if (!hasBreakpoint(pc)) {
+        return false;
+    }
+    const auto it = conditions.find(pc);
+    return it == conditions.end() || it->second.evaluate(machine, pc, machine.bus->ram[pc]) != 0;
+}
+
+Debugger::Stop Debugger::step()
+{
+    pending = {};
+    machine.step();
+    last = pending;
+    return last.reason;
+}
+
+Debugger::Stop Debugger::run(uint64_t cycles)
+{
+    const uint64_t start = machine.cycleCount();
+    pending = {};
+    while (machine.cycleCount() - start < cycles) {
+        machine.step();
+        if (pending.reason != Stop::NONE) {
+            last = pending;
+            return last.reason;
+        }
+        if (exec_count != 0 && breakAt(machine.cpu.pc)) {
+            last = { Stop::BREAKPOINT, machine.cpu.pc, machine.bus->ram[machine.cpu.pc] };
+            return last.reason;
+        }
+    }
+    last = {};
+    return Stop::NONE;
+}
+}
@@ -0,0 +1,212 @@
+﻿#include "emu_thread.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace nes {
+namespace {
+// NTSC 每秒约 60.1 帧
+constexpr auto FRAME_PERIOD = std::chrono::nanoseconds(16639267);
+}
+
+EmuThread::EmuThread(Machine& machine, Debugger& debugger, TimeTravel& history)
+    : machine(machine), debugger(debugger), history(history), cfg(machine.cpu)
+{
+}
+
+EmuThread::~EmuThread()
+{
+    stop();
+}
+
+bool EmuThread::watchPage(uint8_t page)
+{
+    if (worker.joinable() || page_count == MAX_PAGES) {
+        return false;
+    }
+    page_numbers[page_count++] = page;
+    return true;
+}
+
+void EmuThread::start()
+{
+    if (worker.joinable()) {
+        return;
+    }
+    stopping.store(false);
+    // 先在调用线程上发布一份，界面第一帧就有东西可画
+    publish();
+    worker = std::thread(&EmuThread::threadLoop, this);
+}
+
+void EmuThread::stop()
+{
+    if (worker.joinable()) {
+        stopping.store(true, std::memory_order_release);
+        signal.fetch_add(1, std::memory_order_release);
+        signal.notify_one();
+        worker.join();
+    }
+}
+
+bool EmuThread::post(Command command)
+{
+    const uint32_t tail = posted.load(std::memory_order_relaxed);
+    if (tail - taken.load(std::memory_order_acquire) >= QUEUE_SIZE) {
+        return false;
+    }
+    queue[tail % QUEUE_SIZE] = command;
+    posted.store(tail + 1, std::memory_order_release);
+    signal.fetch_add(1, std::memory_order_release);
+    signal.notify_one();
+    return true;
+}
+
+void EmuThread::threadLoop()
+{
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point deadline = Clock::now();
+    while (!stopping.load(std::memory_order_acquire)) {
+        const uint32_t seen = signal.load(std::memory_order_acquire);
+        const uint32_t tail = posted.load(std::memory_order_acquire);
+        uint32_t head = taken.load(std::memory_order_relaxed);
+        const bool changed = head != tail;
+        for (; head != tail; head++) {
+            execute(queue[head % QUEUE_SIZE]);
+            taken.store(head + 1, std::memory_order_release);
+        }
+
+        if (running) {
+            runFrame();
+            publish();
+            if (throttled) {
+                // 落后超过一帧时不追赶，从现在重新计时
+                deadline = std::max(deadline + FRAME_PERIOD, Clock::now() - FRAME_PERIOD);
+                std::this_thread::sleep_until(deadline);
+            }
+            continue;
+        }
+
+        if (changed) {
+            publish();
+        }
+        // 暂停时没事可做，等下一条命令
+        signal.wait(seen, std::memory_order_acquire);
+        deadline = Clock::now();
+    }
+}
+
+void EmuThread::execute(Command command)
+{
+    switch (command) {
+    case Command::STEP:
+        running = false;
+        history.step();
+        break;
+    case Command::REVERSE_STEP:
+        running = false;
+        history.reverseStep();
+        break;
+    case Command::REVERSE_CONTINUE:
+        running = false;
+        stopped = history.reverseContinue() != Debugger::Stop::NONE;
+        stop_address = debugger.lastHit().address;
+        break;
+    case Command::TOGGLE_BREAKPOINT:
+        debugger.toggleBreakpoint(machine.cpu.pc);
+        break;
+    case Command::RUN_PAUSE:
+        running = !running;
+        stopped = false;
+        break;
+    case Command::RESET:
+        history.reset();
+        break;
+    case Command::IRQ:
+        history.irq();
+        break;
+    case Command::NMI:
+        history.nmi();
+        break;
+    case Command::THROTTLE:
+        throttled = !throttled;
+        break;
+    }
+}
+
+// 跑到下一个帧边界，命中断点/观察点就停下
+void EmuThread::runFrame()
+{
+    const uint64_t frameEnd = (machine.frameCount() + 1) * PPU_DOTS_PER_FRAME / 3;
+    const uint64_t now = machine.cycleCount();
+    if (history.run(frameEnd > now ? frameEnd - now : 1) != Debugger::Stop::NONE) {
+        running = false;
+        stopped = true;
+        stop_address = debugger.lastHit().address;
+    }
+}
+
+void EmuThread::publish()
+{
+    OLC6502& cpu = machine.cpu;
+
+    // 执行到了还没分析过的地方时把 PC 当作新入口；代码没变时分析直接命中缓存
+    if (!cfg.isInstruction(cpu.pc)) {
+        cfg.addEntry(cpu.pc);
+    }
+    if (cfg.analyze(*machine.bus)) {
+        code = cfg.disassemble(cpu);
+    }
+
+    State& s = states.back();
+    s.sequence = ++sequence;
+    s.cycle = machine.cycleCount();
+    s.frame = machine.frameCount();
+    s.pc = cpu.pc;
+    s.a = cpu.a;
+    s.x = cpu.x;
+    s.y = cpu.y;
+    s.sp = cpu.sp;
+    s.status = cpu.status;
+    s.running = running;
+    s.throttled = throttled;
+    s.stopped = stopped;
+    s.stopAddress = stop_address;
+    s.inputStamp = machine.controllers.latchedStamp(0);
+
+    s.pageCount = page_count;
+    s.pageNumbers = page_numbers;
+    for (size_t i = 0; i < page_count; i++) {
+        s.pageGenerations[i] = machine.bus->pageGeneration(page_numbers[i]);
+        machine.bus->peek(static_cast<uint16_t>(page_numbers[i] << 8), s.pages[i]);
+    }
+
+    // PC 上下各 CODE_LINES / 2 行
+    for (CodeLine& line : s.code) {
+        line.address = 0x0000;
+        line.breakpoint = false;
+        line.text[0] = '\0';
+    }
+    const auto at = code.find(cpu.pc);
+    if (at != code.end()) {
+        const ptrdiff_t centre = CODE_LINES / 2;
+        auto it = at;
+        ptrdiff_t first = centre;
+        while (first > 0 && it != code.begin()) {
+            --it;
+            first--;
+        }
+        for (size_t i = static_cast<size_t>(first); i < CODE_LINES && it != code.end(); i++, ++it) {
+            CodeLine& line = s.code[i];
+            line.address = it->first;
+            line.breakpoint = debugger.hasBreakpoint(it->first);
+            const size_t n = std::min(it->second.size(), sizeof(line.text) - 1);
+            std::memcpy(line.text, it->second.data(), n);
+            line.text[n] = '\0';
+        }
+    }
+
+    states.publish();
+}
+}
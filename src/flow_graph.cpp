@@ -0,0 +1,226 @@
+﻿#include "flow_graph.h"
+
+#include <algorithm>
+
+namespace nes {
+namespace {
+constexpr uint16_t NMI_VECTOR = 0xFFFA;
+constexpr uint16_t RESET_VECTOR = 0xFFFC;
+constexpr uint16_t IRQ_VECTOR = 0xFFFE;
+
+uint16_t word(const Bus& bus, uint16_t address)
+{
+    return static_cast<uint16_t>(bus.ram[address] | (bus.ram[static_cast<uint16_t>(address + 1)] << 8));
+}
+}
+
+ControlFlowGraph::ControlFlowGraph(const OLC6502& cpu)
+    : cpu(cpu)
+{
+    static const char* const BRANCHES[] = { "BPL", "BMI", "BVC", "BVS", "BCC", "BCS", "BNE", "BEQ" };
+    for (int op = 0; op < 256; op++) {
+        const std::string& name = cpu.getInstructionName(static_cast<uint8_t>(op));
+        Exit exit = Exit::FALLTHROUGH;
+        if (std::find(std::begin(BRANCHES), std::end(BRANCHES), name) != std::end(BRANCHES)) {
+            exit = Exit::BRANCH;
+            branch[op] = true;
+        }
+        else if (op == 0x4C) {
+            exit = Exit::JUMP;
+        }
+        else if (op == 0x6C) {
+            exit = Exit::JUMP_INDIRECT;
+        }
+        else if (op == 0x20) {
+            exit = Exit::CALL;
+        }
+        else if (op == 0x60 || op == 0x40) {
+            exit = Exit::RETURN;
+        }
+        else if (op == 0x00 || name == "???") {
+            exit = Exit::HALT;
+        }
+        exits[op] = exit;
+    }
+    block_index.fill(-1);
+}
+
+void ControlFlowGraph::addEntry(uint16_t address)
+{
+    if (std::find(extra_entries.begin(), extra_entries.end(), address) == extra_entries.end()) {
+        extra_entries.push_back(address);
+    }
+}
+
+void ControlFlowGraph::clearEntries()
+{
+    extra_entries.clear();
+}
+
+ControlFlowGraph::Exit ControlFlowGraph::exitOf(uint8_t opcode) const
+{
+    return exits[opcode];
+}
+
+std::vector<uint16_t> ControlFlowGraph::collectEntries(const Bus& bus) const
+{
+    std::vector<uint16_t> entries = { word(bus, RESET_VECTOR), word(bus, NMI_VECTOR), word(bus, IRQ_VECTOR) };
+    entries.insert(entries.end(), extra_entries.begin(), extra_entries.end());
+#if NES_CDL
+    if (use_cdl) {
+        for (uint32_t a = 0; a < 0x10000; a++) {
+            if (bus.cdlFlags(static_cast<uint16_t>(a)) & Bus::CDL_OPCODE) {
+                entries.push_back(static_cast<uint16_t>(a));
+            }
+        }
+    }
+#endif
+    std::sort(entries.begin(), entries.end());
+    entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+    return entries;
+}
+
+// 上次分析解码过的所有字节的 FNV-1a 哈希
+uint64_t ControlFlowGraph::codeHash(const Bus& bus) const
+{
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (const Block& b : block_list) {
+        for (uint16_t i = 0; i < b.size; i++) {
+            h ^= bus.ram[static_cast<uint16_t>(b.start + i)];
+            h *= 0x100000001B3ULL;
+        }
+    }
+    return h;
+}
+
+bool ControlFlowGraph::analyze(const Bus& bus)
+{
+    std::vector<uint16_t> entries = collectEntries(bus);
+    if (valid && entries == cached_entries && codeHash(bus) == cached_hash) {
+        return false;
+    }
+
+    // 第一遍: 从入口出发走遍可达指令，记下指令起点和块的起点（入口、跳转目标、分支/调用之后）
+    std::array<uint64_t, 1024> leaders{};
+    instruction_bits.fill(0);
+    auto test = [](const std::array<uint64_t, 1024>& bits, uint16_t a) { return (bits[a >> 6] >> (a & 63)) & 1; };
+    auto set = [](std::array<uint64_t, 1024>& bits, uint16_t a) { bits[a >> 6] |= 1ULL << (a & 63); };
+
+    std::vector<uint16_t> work(entries.begin(), entries.end());
+    for (uint16_t e : entries) {
+        set(leaders, e);
+    }
+    while (!work.empty()) {
+        uint16_t pc = work.back();
+        work.pop_back();
+        while (!test(instruction_bits, pc)) {
+            set(instruction_bits, pc);
+            const uint8_t op = bus.ram[pc];
+            const uint16_t next = static_cast<uint16_t>(pc + cpu.getInstructionLength(op));
+            const Exit exit = exitOf(op);
+            if (exit == Exit::FALLTHROUGH) {
+                pc = next;
+                continue;
+            }
+            if (exit == Exit::BRANCH) {
+                const uint16_t target = static_cast<uint16_t>(next + static_cast<int8_t>(bus.ram[static_cast<uint16_t>(pc + 1)]));
+                set(leaders, target);
+                set(leaders, next);
+                work.push_back(target);
+                work.push_back(next);
+            }
+            else if (exit == Exit::JUMP || exit == Exit::CALL) {
+                const uint16_t target = word(bus, static_cast<uint16_t>(pc + 1));
+                set(leaders, target);
+                work.push_back(target);
+                if (exit == Exit::CALL) {
+                    set(leaders, next);
+                    work.push_back(next);
+                }
+            }
+            break;
+        }
+    }
+
+    // 第二遍: 从每个块起点顺序解码，遇到终结指令或下一个块起点就结束
+    for (const Block& b : block_list) {
+        for (uint16_t i = 0; i < b.size; i++) {
+            block_index[static_cast<uint16_t>(b.start + i)] = -1;
+        }
+    }
+    block_list.clear();
+    for (uint32_t a = 0; a < 0x10000; a++) {
+        const uint16_t start = static_cast<uint16_t>(a);
+        if (!test(leaders, start) || !test(instruction_bits, start)) {
+            continue;
+        }
+        Block b;
+        b.start = start;
+        uint16_t pc = start;
+        for (;;) {
+            const uint8_t op = bus.ram[pc];
+            const uint8_t len = cpu.getInstructionLength(op);
+            const uint16_t next = static_cast<uint16_t>(pc + len);
+            b.last = pc;
+            b.count++;
+            b.size = static_cast<uint16_t>(b.size + len);
+            b.exit = exitOf(op);
+            if (b.exit == Exit::BRANCH) {
+                b.successors = { static_cast<uint16_t>(next + static_cast<int8_t>(bus.ram[static_cast<uint16_t>(pc + 1)])), next };
+                break;
+            }
+            if (b.exit == Exit::JUMP) {
+                b.successors = { word(bus, static_cast<uint16_t>(pc + 1)) };
+                break;
+            }
+            if (b.exit == Exit::CALL) {
+                b.successors = { word(bus, static_cast<uint16_t>(pc + 1)), next };
+                break;
+            }
+            if (b.exit != Exit::FALLTHROUGH) {
+                break;
+            }
+            if (test(leaders, next) || b.size >= 0xFFFD) {
+                b.successors = { next };
+                break;
+            }
+            pc = next;
+        }
+        block_list.push_back(std::move(b));
+    }
+
+    // 地址到块的索引；指令重叠时以起点靠后的块为准
+    for (size_t i = 0; i < block_list.size(); i++) {
+        const Block& b = block_list[i];
+        for (uint16_t k = 0; k < b.size; k++) {
+            block_index[static_cast<uint16_t>(b.start + k)] = static_cast<int32_t>(i);
+        }
+    }
+
+    cached_entries = std::move(entries);
+    cached_hash = codeHash(bus);
+    valid = true;
+    return true;
+}
+
+const ControlFlowGraph::Block* ControlFlowGraph::blockAt(uint16_t address) const
+{
+    const int32_t i = block_index[address];
+    return i >= 0 ? &block_list[static_cast<size_t>(i)] : nullptr;
+}
+
+std::map<uint16_t, std::string> ControlFlowGraph::disassemble(OLC6502& cpu) const
+{
+    std::map<uint16_t, std::string> lines;
+    for (const Block& b : block_list) {
+        // 块内是顺序解码的，线性反汇编不会失步
+        auto part = cpu.disassemble(b.start, static_cast<uint16_t>(b.last - b.start));
+        for (auto& [address, text] : part) {
+            if (isInstruction(address)) {
+                lines[address] = std::move(text);
+            }
+        }
+    }
+    return lines;
+}
+}
@@ -0,0 +1,427 @@
+﻿#include "machine.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <span>
+#include <vector>
+
+#include "video_pipeline.h"
+
+namespace nes {
+namespace {
+constexpr uint8_t STATE_MAGIC[4] = { 'N', 'E', 'S', 'S' };
+constexpr uint32_t STATE_VERSION = 3;
+constexpr size_t STATE_HEADER_SIZE = 8;
+constexpr size_t STATE_CPU_SIZE = 21;
+constexpr size_t STATE_PPU_SIZE = 3;
+constexpr size_t STATE_INPUT_SIZE = 1 + InputState::PORTS;
+
+template <typename T>
+uint8_t* put(uint8_t* p, T v)
+{
+    for (size_t i = 0; i < sizeof(T); i++) {
+        *p++ = static_cast<uint8_t>(static_cast<uint64_t>(v) >> (i * 8));
+    }
+    return p;
+}
+
+template <typename T>
+const uint8_t* get(const uint8_t* p, T& v)
+{
+    uint64_t n = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+        n |= static_cast<uint64_t>(*p++) << (i * 8);
+    }
+    v = static_cast<T>(n);
+    return p;
+}
+}
+
+Machine::Machine()
+{
+    cpu.connectBus(bus);
+}
+
+// VideoPipeline 在头文件里只有声明
+Machine::~Machine() = default;
+
+void Machine::load(uint16_t address, const uint8_t* data, size_t len)
+{
+    len = std::min(len, bus->ram.size() - address);
+    bus->poke(address, std::span<const uint8_t>(data, len));
+    resyncVideo();
+}
+
+void Machine::setResetVector(uint16_t address)
+{
+    const uint8_t vector[2] = { static_cast<uint8_t>(address & 0x00FF), static_cast<uint8_t>((address >> 8) & 0x00FF) };
+    bus->poke(0xFFFC, vector);
+}
+
+bool Machine::loadFile(const std::string& path, uint16_t address, std::string& error)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        error = "can not open file";
+        return false;
+    }
+    const std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    const bool isNes = data.size() >= 4 && std::memcmp(data.data(), "NES\x1A", 4) == 0;
+    if (isNes) {
+        if (data.size() < 16) {
+            error = "bad iNES header";
+            return false;
+        }
+        const size_t prgSize = static_cast<size_t>(data[4]) * 16384;
+        const size_t offset = 16 + ((data[6] & 0x04) ? 512 : 0);
+        if (prgSize == 0 || data.size() < offset + prgSize) {
+            error = "truncated PRG ROM";
+            return false;
+        }
+        prg_size = std::min<size_t>(prgSize, 0x8000);
+        chr_size = static_cast<size_t>(data[5]) * 8192;
+        load(0x8000, data.data() + offset, prg_size);
+        if (prgSize == 16384) {
+            load(0xC000, data.data() + offset, prgSize);
+        }
+    }
+    else if (data.size() == bus->ram.size()) {
+        load(0x0000, data.data(), data.size());
+    }
+    else {
+        load(address, data.data(), data.size());
+        setResetVector(address);
+    }
+    return true;
+}
+
+void Machine::reset()
+{
+    cpu.reset();
+    controllers.reset();
+    ppu.reset();
+    resyncVideo();
+}
+
+void Machine::setControllers(bool enabled)
+{
+    if (enabled) {
+        controllers.attach(*bus);
+    }
+    else {
+        controllers.detach(*bus);
+    }
+}
+
+void Machine::setPpu(bool enabled)
+{
+    ppu_enabled = enabled;
+    if (enabled) {
+        ppu.attach(*bus);
+    }
+    else {
+        ppu.detach(*bus);
+    }
+}
+
+void Machine::setRenderMode(RenderMode mode)
+{
+    if (mode == render_mode) {
+        return;
+    }
+    if (render_mode == RenderMode::PIPELINED) {
+        // 离开 PIPELINED: 不再记日志，等渲染线程交完已经跑完的帧，之后 FrameSink 只在本线程上调用
+        pipeline->detach(*bus);
+        ppu.setLog(nullptr);
+        pipeline->flush();
+    }
+    render_mode = mode;
+    if (mode == RenderMode::PIPELINED) {
+        if (pipeline == nullptr) {
+            pipeline = std::make_unique<VideoPipeline>(cpu);
+        }
+        pipeline->attach(*bus);
+        ppu.setLog(pipeline.get());
+        // 不记日志期间显存可能变过，渲染线程的副本整个重新同步
+        resyncVideo();
+    }
+}
+
+void Machine::flushVideo()
+{
+    if (pipeline != nullptr) {
+        pipeline->flush();
+    }
+}
+
+void Machine::step()
+{
+    cpu.clock();
+    cpu.finishInstruction();
+
+    if (cpu.getCycleCount() >= vblank_at) {
+        vblank_at = UINT64_MAX;
+        ppu.setVblank(true);
+        if (ppu_enabled && ppu.nmiEnabled()) {
+            cpu.nmi();
+        }
+    }
+    if (cpu.getCycleCount() >= frame_end) {
+        endFrame();
+    }
+}
+
+// 按 frame_count 算出这一帧的结束和 vblank 开始的周期
+void Machine::scheduleFrame()
+{
+    const uint64_t start = frame_count * PPU_DOTS_PER_FRAME / 3;
+    frame_end = (frame_count + 1) * PPU_DOTS_PER_FRAME / 3;
+    vblank_at = start + VBLANK_START_CYCLE;
+    if (cpu.getCycleCount() >= vblank_at) {
+        vblank_at = UINT64_MAX;
+    }
+}
+
+void Machine::endFrame()
+{
+    // 预渲染行清掉 vblank
+    ppu.setVblank(false);
+    frame_count++;
+    scheduleFrame();
+    if (render_mode == RenderMode::FULL) {
+        renderFrame();
+    }
+    else if (render_mode == RenderMode::PIPELINED) {
+        pipeline->endFrame(frame_sink);
+    }
+}
+
+void Machine::renderFrame()
+{
+    renderScreen(bus->ram.data() + SCREEN_ADDRESS, ppu.mask(), framebuffer.data());
+    if (frame_sink != nullptr) {
+        frame_sink->onFrame(framebuffer.data(), SCREEN_WIDTH, SCREEN_HEIGHT);
+    }
+}
+
+uint64_t Machine::run(uint64_t cycles)
+{
+    const uint64_t start = cpu.getCycleCount();
+    while (cpu.getCycleCount() - start < cycles) {
+        step();
+    }
+    return cpu.getCycleCount() - start;
+}
+
+uint64_t Machine::runFrames(uint32_t frames)
+{
+    const uint64_t start = cpu.getCycleCount();
+    const uint64_t target = frame_count + frames;
+    while (frame_count < target) {
+        step();
+    }
+    return cpu.getCycleCount() - start;
+}
+
+void Machine::saveSnapshot(Snapshot& snapshot) const
+{
+    snapshot.cpu = cpu.saveState();
+    snapshot.controllers = controllers.saveState();
+    snapshot.ppu = ppu.saveState();
+    snapshot.frame_count = frame_count;
+    snapshot.ram = bus->ram;
+}
+
+void Machine::loadSnapshot(const Snapshot& snapshot)
+{
+    cpu.loadState(snapshot.cpu);
+    controllers.loadState(snapshot.controllers);
+    ppu.loadState(snapshot.ppu);
+    restored();
+    frame_count = snapshot.frame_count;
+    scheduleFrame();
+    bus->ram = snapshot.ram;
+    bus->touchAll();
+    resyncVideo();
+}
+
+void Machine::saveCheckpoint(Checkpoint& checkpoint) const
+{
+    checkpoint.cpu = cpu.saveState();
+    checkpoint.controllers = controllers.saveState();
+    checkpoint.ppu = ppu.saveState();
+    checkpoint.frame_count = frame_count;
+    for (size_t page = 0; page < 256; page++) {
+        const uint32_t generation = bus->pageGeneration(static_cast<uint8_t>(page));
+        if (!checkpoint.valid || checkpoint.generations[page] != generation) {
+            bus->peek(static_cast<uint16_t>(page << 8), std::span<uint8_t>(checkpoint.ram.data() + (page << 8), 256));
+            checkpoint.generations[page] = generation;
+        }
+    }
+    checkpoint.valid = true;
+}
+
+void Machine::loadCheckpoint(Checkpoint& checkpoint)
+{
+    if (!checkpoint.valid) {
+        return;
+    }
+    cpu.loadState(checkpoint.cpu);
+    controllers.loadState(checkpoint.controllers);
+    ppu.loadState(checkpoint.ppu);
+    restored();
+    frame_count = checkpoint.frame_count;
+    scheduleFrame();
+    for (size_t page = 0; page < 256; page++) {
+        if (checkpoint.generations[page] != bus->pageGeneration(static_cast<uint8_t>(page))) {
+            // poke 会让这一页的代数加一，之后它的内容又和检查点一致了
+            bus->poke(static_cast<uint16_t>(page << 8), std::span<const uint8_t>(checkpoint.ram.data() + (page << 8), 256));
+            checkpoint.generations[page] = bus->pageGeneration(static_cast<uint8_t>(page));
+        }
+    }
+    resyncVideo();
+}
+
+// CPU 状态已经恢复之后调用
+void Machine::restored()
+{
+    restore_count++;
+    restore_cycle = cpu.getCycleCount();
+    if (bus->tracer != nullptr) {
+        bus->tracer->onRestore(restore_cycle);
+    }
+}
+
+// 绕过总线改了显存或 $2001 之后，让渲染线程的副本跟上
+void Machine::resyncVideo()
+{
+    if (render_mode == RenderMode::PIPELINED) {
+        pipeline->resync(bus->ram.data(), ppu.mask());
+    }
+}
+
+bool Machine::saveCdl(const std::string& path, std::string& error) const
+{
+#if NES_CDL
+    // FCEUX: bit0 代码，bit1 数据，bit2-3 访问时所在的 8K 窗口（CPU 地址的 bit13-14）
+    std::vector<uint8_t> out(prg_size + chr_size, 0);
+    for (uint32_t address = 0x8000; address <= 0xFFFF; address++) {
+        const uint8_t flags = bus->cdlFlags(static_cast<uint16_t>(address));
+        if (flags == 0) {
+            continue;
+        }
+        uint8_t& b = out[(address - 0x8000) % prg_size];
+        if (flags & (Bus::CDL_OPCODE | Bus::CDL_OPERAND)) {
+            b |= 0x01;
+        }
+        if (flags & Bus::CDL_READ) {
+            b |= 0x02;
+        }
+        b |= static_cast<uint8_t>(((address >> 13) & 0x03) << 2);
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        error = "can not open file";
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(out.data()), static_cast<std::streamsize>(out.size()));
+    if (!file) {
+        error = "write failed";
+        return false;
+    }
+    return true;
+#else
+    (void)path;
+    error = "built without NES_CDL, rebuild with -DNES_CDL=ON";
+    return false;
+#endif
+}
+
+size_t Machine::stateSize()
+{
+    return STATE_HEADER_SIZE + STATE_CPU_SIZE + STATE_PPU_SIZE + STATE_INPUT_SIZE + sizeof(uint64_t) + 64 * 1024;
+}
+
+bool Machine::saveState(uint8_t* buffer, size_t size) const
+{
+    if (buffer == nullptr || size < stateSize()) {
+        return false;
+    }
+
+    const OLC6502::State state = cpu.saveState();
+    uint8_t* p = std::copy(std::begin(STATE_MAGIC), std::end(STATE_MAGIC), buffer);
+    p = put(p, STATE_VERSION);
+    p = put(p, state.a);
+    p = put(p, state.x);
+    p = put(p, state.y);
+    p = put(p, state.sp);
+    p = put(p, state.pc);
+    p = put(p, state.status);
+    p = put(p, state.addr_abs);
+    p = put(p, state.addr_rel);
+    p = put(p, state.opcode);
+    p = put(p, state.cycles);
+    p = put(p, state.cycle_count);
+    const PpuRegisters::State video = ppu.saveState();
+    p = put(p, video.ctrl);
+    p = put(p, video.mask);
+    p = put(p, video.status);
+    const Controllers::State input = controllers.saveState();
+    p = put(p, input.strobe);
+    for (uint8_t shift : input.shift) {
+        p = put(p, shift);
+    }
+    p = put(p, frame_count);
+    std::copy(bus->ram.begin(), bus->ram.end(), p);
+    return true;
+}
+
+bool Machine::loadState(const uint8_t* buffer, size_t size)
+{
+    if (buffer == nullptr || size < stateSize() || !std::equal(std::begin(STATE_MAGIC), std::end(STATE_MAGIC), buffer)) {
+        return false;
+    }
+
+    uint32_t version = 0;
+    const uint8_t* p = get(buffer + 4, version);
+    if (version != STATE_VERSION) {
+        return false;
+    }
+
+    OLC6502::State state;
+    p = get(p, state.a);
+    p = get(p, state.x);
+    p = get(p, state.y);
+    p = get(p, state.sp);
+    p = get(p, state.pc);
+    p = get(p, state.status);
+    p = get(p, state.addr_abs);
+    p = get(p, state.addr_rel);
+    p = get(p, state.opcode);
+    p = get(p, state.cycles);
+    p = get(p, state.cycle_count);
+    PpuRegisters::State video;
+    p = get(p, video.ctrl);
+    p = get(p, video.mask);
+    p = get(p, video.status);
+    Controllers::State input;
+    p = get(p, input.strobe);
+    for (uint8_t& shift : input.shift) {
+        p = get(p, shift);
+    }
+    p = get(p, frame_count);
+    cpu.loadState(state);
+    ppu.loadState(video);
+    controllers.loadState(input);
+    restored();
+    scheduleFrame();
+    std::copy(p, p + bus->ram.size(), bus->ram.begin());
+    bus->touchAll();
+    resyncVideo();
+    return true;
+}
+}
@@ -0,0 +1,156 @@
+﻿// nes_bench - 量预测执行（run-ahead）在 N = 0..4 时占用的帧预算
+//
+//   nes_bench <program> [--load-addr A] [--frames N] [--max-ahead N]
+//
+// 对每个 N 从同一个起点出发跑 frames 帧，报告每帧的检查点存/取、模拟和总耗时，
+// 以及总耗时占 NTSC 一帧（16.64 ms）的比例。最后给出完整快照存取的耗时作对比，
+// 并比较同步渲染（FULL）和渲染线程（PIPELINED）下 CPU 线程每帧的耗时，检查两者的画面逐帧一致。
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "machine.h"
+#include "run_ahead.h"
+
+using namespace nes;
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// NTSC 每帧约 16639 微秒
+constexpr double FRAME_BUDGET = 16639.267;
+
+void usage()
+{
+    std::fprintf(stderr, "usage: nes_bench <program> [--load-addr A] [--frames N] [--max-ahead N]\n");
+}
+
+// 只收画面不处理，让 FULL 模式的开销算进去
+class NullSink : public FrameSink {
+public:
+    void onFrame(const uint32_t*, int, int) override {}
+};
+
+// 记下每帧画面的 FNV-1a 哈希
+class HashSink : public FrameSink {
+public:
+    void onFrame(const uint32_t* rgba, int width, int height) override {
+        uint64_t h = 14695981039346656037ull;
+        for (int i = 0; i < width * height; i++) {
+            h = (h ^ rgba[i]) * 1099511628211ull;
+        }
+        hashes.push_back(h);
+    }
+
+    std::vector<uint64_t> hashes;
+};
+
+// 从 start 出发按 mode 跑 frames 帧，返回 CPU 线程上每帧的微秒数（包括最后等渲染线程跑完）
+double videoFrame(const Machine::Snapshot& start, RenderMode mode, uint32_t frames, HashSink& sink)
+{
+    auto m = std::make_unique<Machine>();
+    m->setRenderMode(mode);
+    m->loadSnapshot(start);
+    m->setFrameSink(&sink);
+    sink.hashes.reserve(frames);
+    const Clock::time_point t0 = Clock::now();
+    m->runFrames(frames);
+    m->flushVideo();
+    return std::chrono::duration<double, std::micro>(Clock::now() - t0).count() / frames;
+}
+}
+
+int main(int argc, char* argv[])
+{
+    std::string program;
+    uint16_t loadAddr = 0x8000;
+    uint32_t frames = 600;
+    uint32_t maxAhead = 4;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            program = arg;
+        }
+        else if (i + 1 >= argc) {
+            usage();
+            return 2;
+        }
+        else if (arg == "--load-addr") loadAddr = static_cast<uint16_t>(std::strtoul(argv[++i], nullptr, 0));
+        else if (arg == "--frames") frames = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+        else if (arg == "--max-ahead") maxAhead = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (program.empty() || frames < RunAhead::WINDOW) {
+        usage();
+        return 2;
+    }
+    if (maxAhead > RunAhead::MAX_FRAMES) {
+        std::fprintf(stderr, "--max-ahead is at most %u\n", RunAhead::MAX_FRAMES);
+        return 2;
+    }
+
+    NullSink sink;
+    auto boot = std::make_unique<Machine>();
+    std::string error;
+    if (!boot->loadFile(program, loadAddr, error)) {
+        std::fprintf(stderr, "%s: %s\n", program.c_str(), error.c_str());
+        return 1;
+    }
+    boot->reset();
+    auto start = std::make_unique<Machine::Snapshot>();
+    boot->saveSnapshot(*start);
+
+    std::printf("ahead   save us  restore us  emulate us   total us  budget\n");
+    for (uint32_t n = 0; n <= maxAhead; n++) {
+        auto m = std::make_unique<Machine>();
+        m->loadSnapshot(*start);
+        m->setFrameSink(&sink);
+        RunAhead runAhead(*m, n);
+
+        double save = 0.0;
+        double restore = 0.0;
+        double emulate = 0.0;
+        double total = 0.0;
+        uint32_t windows = 0;
+        for (uint32_t f = 1; f <= frames; f++) {
+            runAhead.runFrame();
+            if (f % RunAhead::WINDOW == 0) {
+                const RunAhead::Metrics& r = runAhead.metrics();
+                save += r.save;
+                restore += r.restore;
+                emulate += r.emulate;
+                total += r.total;
+                windows++;
+            }
+        }
+        std::printf("%5u %9.2f %11.2f %11.1f %10.1f %6.1f%%\n", n, save / windows, restore / windows,
+            emulate / windows, total / windows, total / windows / FRAME_BUDGET * 100.0);
+    }
+
+    // 对比: 每次都完整拷贝 64K 的快照
+    const uint32_t reps = 1000;
+    auto snapshot = std::make_unique<Machine::Snapshot>();
+    const Clock::time_point t0 = Clock::now();
+    for (uint32_t i = 0; i < reps; i++) {
+        boot->saveSnapshot(*snapshot);
+        boot->loadSnapshot(*snapshot);
+    }
+    const double full = std::chrono::duration<double, std::micro>(Clock::now() - t0).count() / reps;
+    std::printf("full snapshot save + load: %.2f us\n", full);
+
+    HashSink sync;
+    HashSink pipelined;
+    const double syncFrame = videoFrame(*start, RenderMode::FULL, frames, sync);
+    const double pipelinedFrame = videoFrame(*start, RenderMode::PIPELINED, frames, pipelined);
+    const bool same = sync.hashes == pipelined.hashes;
+    std::printf("video: sync %.1f us/frame, pipelined %.1f us/frame, %zu frames %s\n", syncFrame, pipelinedFrame,
+        pipelined.hashes.size(), same ? "identical" : "DIFFER");
+    return same ? 0 : 1;
+}
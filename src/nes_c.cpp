@@ -0,0 +1,208 @@
+﻿#include "nes_c.h"
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+
+#include <spdlog/spdlog.h>
+
+#include "machine.h"
+#include "parallel.h"
+
+struct nes_machine
+{
+    nes::Machine m;
+};
+
+namespace {
+nes::ThreadPool& pool()
+{
+    static nes::ThreadPool instance;
+    return instance;
+}
+
+// 批量接口同一时间只允许一个调用者使用线程池
+std::mutex& poolLock()
+{
+    static std::mutex lock;
+    return lock;
+}
+}
+
+extern "C" {
+
+int nes_api_version(void)
+{
+    return NES_API_VERSION;
+}
+
+nes_machine* nes_create(void)
+{
+    // Machine 的成员（总线等）自己也会分配内存
+    try {
+        return new nes_machine();
+    }
+    catch (const std::exception& e) {
+        spdlog::error("nes_create: {}", e.what());
+        return nullptr;
+    }
+}
+
+void nes_destroy(nes_machine* machine)
+{
+    delete machine;
+}
+
+int nes_load(nes_machine* machine, uint16_t address, const uint8_t* data, size_t len)
+{
+    if (machine == nullptr || (data == nullptr && len > 0)) {
+        return NES_ERR_ARG;
+    }
+    machine->m.load(address, data, len);
+    return NES_OK;
+}
+
+int nes_load_file(nes_machine* machine, const char* path, uint16_t address)
+{
+    if (machine == nullptr || path == nullptr) {
+        return NES_ERR_ARG;
+    }
+    try {
+        std::string error;
+        if (!machine->m.loadFile(path, address, error)) {
+            spdlog::error("nes_load_file: {}: {}", path, error);
+            return NES_ERR_IO;
+        }
+        return NES_OK;
+    }
+    catch (const std::exception& e) {
+        spdlog::error("nes_load_file: {}: {}", path, e.what());
+        return NES_ERR_INTERNAL;
+    }
+}
+
+int nes_set_reset_vector(nes_machine* machine, uint16_t address)
+{
+    if (machine == nullptr) {
+        return NES_ERR_ARG;
+    }
+    machine->m.setResetVector(address);
+    return NES_OK;
+}
+
+int nes_reset(nes_machine* machine)
+{
+    if (machine == nullptr) {
+        return NES_ERR_ARG;
+    }
+    machine->m.reset();
+    return NES_OK;
+}
+
+uint64_t nes_run_frames(nes_machine* machine, uint32_t frames)
+{
+    if (machine == nullptr) {
+        return 0;
+    }
+    return machine->m.runFrames(frames);
+}
+
+int nes_run_frames_batch(nes_machine* const* machines, size_t count, uint32_t frames)
+{
+    if (machines == nullptr && count > 0) {
+        return NES_ERR_ARG;
+    }
+    try {
+        std::lock_guard<std::mutex> guard(poolLock());
+        // 工作线程上的异常不能逃出 parallelFor，记下来由调用线程返回
+        std::atomic<bool> failed{ false };
+        pool().parallelFor(count, [&](size_t i)
+        {
+            try {
+                if (machines[i] != nullptr) {
+                    machines[i]->m.runFrames(frames);
+                }
+            }
+            catch (const std::exception&) {
+                failed.store(true, std::memory_order_relaxed);
+            }
+        });
+        return failed.load(std::memory_order_relaxed) ? NES_ERR_INTERNAL : NES_OK;
+    }
+    catch (const std::exception& e) {
+        spdlog::error("nes_run_frames_batch: {}", e.what());
+        return NES_ERR_INTERNAL;
+    }
+}
+
+int nes_peek(const nes_machine* machine, uint16_t address, uint8_t* out, size_t len)
+{
+    if (machine == nullptr || (out == nullptr && len > 0)) {
+        return NES_ERR_ARG;
+    }
+    // 不经过总线的 read，也就不会触发观察者
+    machine->m.bus->peek(address, std::span<uint8_t>(out, len));
+    return NES_OK;
+}
+
+int nes_poke(nes_machine* machine, uint16_t address, const uint8_t* data, size_t len)
+{
+    if (machine == nullptr || (data == nullptr && len > 0)) {
+        return NES_ERR_ARG;
+    }
+    machine->m.bus->poke(address, std::span<const uint8_t>(data, len));
+    return NES_OK;
+}
+
+int nes_get_registers(const nes_machine* machine, nes_registers* out)
+{
+    if (machine == nullptr || out == nullptr) {
+        return NES_ERR_ARG;
+    }
+    const nes::OLC6502& cpu = machine->m.cpu;
+    out->a = cpu.a;
+    out->x = cpu.x;
+    out->y = cpu.y;
+    out->sp = cpu.sp;
+    out->status = cpu.status;
+    out->pc = cpu.pc;
+    return NES_OK;
+}
+
+uint64_t nes_cycle_count(const nes_machine* machine)
+{
+    return machine != nullptr ? machine->m.cycleCount() : 0;
+}
+
+uint64_t nes_frame_count(const nes_machine* machine)
+{
+    return machine != nullptr ? machine->m.frameCount() : 0;
+}
+
+size_t nes_state_size(void)
+{
+    return nes::Machine::stateSize();
+}
+
+int nes_save_state(const nes_machine* machine, uint8_t* buffer, size_t size)
+{
+    if (machine == nullptr || buffer == nullptr) {
+        return NES_ERR_ARG;
+    }
+    return machine->m.saveState(buffer, size) ? NES_OK : NES_ERR_SIZE;
+}
+
+int nes_load_state(nes_machine* machine, const uint8_t* buffer, size_t size)
+{
+    if (machine == nullptr || buffer == nullptr) {
+        return NES_ERR_ARG;
+    }
+    if (size < nes::Machine::stateSize()) {
+        return NES_ERR_SIZE;
+    }
+    return machine->m.loadState(buffer, size) ? NES_OK : NES_ERR_FORMAT;
+}
+}
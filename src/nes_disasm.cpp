@@ -0,0 +1,110 @@
+﻿// nes_disasm - 按 bank 并行反汇编整个 .nes 的 PRG
+//
+//   nes_disasm <rom.nes> [--cdl FILE] [--threads N] [--bank N] [--out FILE]
+//
+// 有 CDL 时以其中的代码段为入口做控制流分析；没有时固定 bank 从中断向量出发分析，
+// 其余 bank 线性反汇编。结果按 bank 顺序边算边输出（每个 bank 一完成就写出，不等全部结束），
+// 同时报告第一个 bank 输出和全部完成的耗时。
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "rom_disasm.h"
+
+using namespace nes;
+
+namespace {
+void usage()
+{
+    std::fprintf(stderr, "usage: nes_disasm <rom.nes> [--cdl FILE] [--threads N] [--bank N] [--out FILE]\n");
+}
+
+void writeBank(std::FILE* out, const RomDisassembly& dis, size_t bank)
+{
+    std::fprintf(out, "; bank %zu at $%04X\n", bank, dis.bankBase(bank));
+    const RomDisassembly::Line* lines = dis.bank(bank);
+    for (size_t i = 0; i < RomDisassembly::BANK_SIZE; i++) {
+        if (lines[i].length != 0) {
+            std::fprintf(out, "%s\n", lines[i].text);
+        }
+    }
+}
+}
+
+int main(int argc, char* argv[])
+{
+    std::string rom;
+    std::string cdl;
+    std::string outPath;
+    unsigned threads = 0;
+    long onlyBank = -1;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            rom = arg;
+        }
+        else if (i + 1 >= argc) {
+            usage();
+            return 2;
+        }
+        else if (arg == "--cdl") cdl = argv[++i];
+        else if (arg == "--threads") threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 0));
+        else if (arg == "--bank") onlyBank = std::strtol(argv[++i], nullptr, 0);
+        else if (arg == "--out") outPath = argv[++i];
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (rom.empty()) {
+        usage();
+        return 2;
+    }
+
+    RomDisassembly dis;
+    std::string error;
+    if (!dis.open(rom, cdl, error)) {
+        std::fprintf(stderr, "%s: %s\n", rom.c_str(), error.c_str());
+        return 1;
+    }
+    if (onlyBank >= static_cast<long>(dis.bankCount())) {
+        std::fprintf(stderr, "bank %ld out of range (%zu banks)\n", onlyBank, dis.bankCount());
+        return 2;
+    }
+
+    std::FILE* out = outPath.empty() ? stdout : std::fopen(outPath.c_str(), "w");
+    if (out == nullptr) {
+        std::fprintf(stderr, "can not open %s\n", outPath.c_str());
+        return 1;
+    }
+
+    const auto t0 = std::chrono::steady_clock::now();
+    dis.start(threads);
+    double first = -1.0;
+    for (size_t b = 0; b < dis.bankCount(); b++) {
+        if (onlyBank >= 0 && static_cast<size_t>(onlyBank) != b) {
+            continue;
+        }
+        // 固定 bank 先算，其余 bank 按编号依次等，前面的 bank 一好就先写出去
+        while (!dis.bankReady(b)) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        writeBank(out, dis, b);
+        std::fflush(out);
+        if (first < 0.0) {
+            first = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        }
+    }
+    dis.wait();
+    const double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (out != stdout) {
+        std::fclose(out);
+    }
+
+    std::fprintf(stderr, "%zu banks, first bank in %.1f ms, all in %.1f ms\n",
+        dis.bankCount(), first * 1000.0, total * 1000.0);
+    return 0;
+}
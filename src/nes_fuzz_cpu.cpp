@@ -0,0 +1,168 @@
+﻿// nes_fuzz_cpu - OLC6502 的 libFuzzer 入口
+//
+// 输入格式: a x y sp status pc_lo pc_hi，后面的字节作为程序装入 pc 处。
+// 每个输入最多运行 FUZZ_CYCLE_BUDGET 个周期，过程中检查:
+//   - 剩余周期数始终在合理范围内
+//   - 执行后的 PC 与解码结果一致: 普通指令前进长度表给出的字节数，分支指令落在下一条或目标上，
+//     JMP/JSR 落在操作数（间接 JMP 为指针指向的地址）上；BRK/RTI/RTS 的去向取决于向量和栈，不检查
+//   - 每 DISASM_SAMPLE 条指令抽查一次，disassemble 给出的长度与长度表一致
+// 越界访问由 AddressSanitizer 负责发现。
+//
+// 不用 libFuzzer 编译时（NES_FUZZ_STANDALONE），main 依次回放命令行给出的输入文件，
+// 用于复现崩溃。
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "machine.h"
+
+using namespace nes;
+
+namespace {
+constexpr uint64_t FUZZ_CYCLE_BUDGET = 4096;
+constexpr uint8_t MAX_INSTRUCTION_CYCLES = 16;
+constexpr size_t HEADER_SIZE = 7;
+// disassemble 每次都要建一张 map，只抽查，逐条比较用长度表
+constexpr uint32_t DISASM_SAMPLE = 64;
+
+// 整个进程只建一台机器，每个输入走快速复位，不重新构造 shared_ptr<Bus>
+Machine& machine()
+{
+    static Machine m;
+    return m;
+}
+
+[[noreturn]] void fail(const char* what, uint16_t pc, const std::string& line)
+{
+    std::fprintf(stderr, "invariant violated: %s at $%04X: %s\n", what, pc, line.c_str());
+    std::abort();
+}
+
+bool isOneOf(const std::string& mnemonic, std::initializer_list<const char*> names)
+{
+    for (const char* n : names) {
+        if (mnemonic == n) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 执行前按解码结果算出指令执行后 PC 可能的值（分支有两个），any 表示不检查
+struct NextPc
+{
+    uint16_t fallThrough = 0;
+    uint16_t target = 0;
+    bool any = false;
+};
+
+NextPc expectedNextPc(const std::string& mnemonic, uint8_t opcode, uint16_t pc, uint8_t length, const Bus& bus)
+{
+    const uint8_t lo = bus.ram[static_cast<uint16_t>(pc + 1)];
+    const uint8_t hi = bus.ram[static_cast<uint16_t>(pc + 2)];
+    const uint16_t operand = static_cast<uint16_t>(lo | (hi << 8));
+    NextPc next;
+    next.fallThrough = static_cast<uint16_t>(pc + length);
+    next.target = next.fallThrough;
+    if (isOneOf(mnemonic, { "BCC", "BCS", "BEQ", "BMI", "BNE", "BPL", "BVC", "BVS" })) {
+        next.target = static_cast<uint16_t>(next.fallThrough + static_cast<int8_t>(lo));
+    }
+    else if (opcode == 0x6C) {
+        // 本核心的间接 JMP 跨页时不回绕（见 OLC6502::IND）
+        next.fallThrough = next.target = static_cast<uint16_t>(
+            bus.ram[operand] | (bus.ram[static_cast<uint16_t>(operand + 1)] << 8));
+    }
+    else if (isOneOf(mnemonic, { "JMP", "JSR" })) {
+        next.fallThrough = next.target = operand;
+    }
+    else if (isOneOf(mnemonic, { "BRK", "RTI", "RTS" })) {
+        next.any = true;
+    }
+    return next;
+}
+
+// 反汇编器和长度表互相核对
+void checkDisassembly(OLC6502& cpu, uint16_t pc, uint8_t length)
+{
+    const auto lines = cpu.disassemble(pc, 3);
+    const auto it = lines.find(pc);
+    if (it == lines.end()) {
+        fail("no disassembly", pc, "");
+    }
+    // 先被当作数据读过的字节会按 CDL 显示成 .DB，不比较长度
+    const auto next = std::next(it);
+    const bool isData = it->second.find(".DB") != std::string::npos;
+    if (!isData && next != lines.end() && next->first != static_cast<uint16_t>(pc + length)) {
+        fail("disassembly length disagrees with length table", pc, it->second);
+    }
+}
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    if (size < HEADER_SIZE) {
+        return 0;
+    }
+
+    Machine& m = machine();
+    m.bus->reset();
+    m.bus->clearCdl();
+
+    OLC6502::State state;
+    state.a = data[0];
+    state.x = data[1];
+    state.y = data[2];
+    state.sp = data[3];
+    state.status = data[4] | OLC6502::U;
+    state.pc = static_cast<uint16_t>(data[5] | (data[6] << 8));
+    m.cpu.loadState(state);
+
+    // 程序从 pc 开始装入，超出 $FFFF 时回绕
+    for (size_t i = HEADER_SIZE; i < size && i - HEADER_SIZE < m.bus->ram.size(); i++) {
+        m.bus->ram[static_cast<uint16_t>(state.pc + (i - HEADER_SIZE))] = data[i];
+    }
+
+    uint32_t count = 0;
+    while (m.cycleCount() < FUZZ_CYCLE_BUDGET) {
+        const uint16_t pc = m.cpu.pc;
+        const uint8_t opcode = m.bus->ram[pc];
+        const uint8_t length = m.cpu.getInstructionLength(opcode);
+        const std::string& name = m.cpu.getInstructionName(opcode);
+        const NextPc next = expectedNextPc(name, opcode, pc, length, *m.bus);
+        if (count++ % DISASM_SAMPLE == 0) {
+            checkDisassembly(m.cpu, pc, length);
+        }
+
+        do {
+            m.cpu.clock();
+            if (m.cpu.getRemainingCycles() > MAX_INSTRUCTION_CYCLES) {
+                fail("cycles out of range", pc, name);
+            }
+        } while (!m.cpu.complete());
+
+        if (!next.any && m.cpu.pc != next.fallThrough && m.cpu.pc != next.target) {
+            fail("next pc disagrees with the decoded instruction", pc, name);
+        }
+    }
+    return 0;
+}
+
+#if defined(NES_FUZZ_STANDALONE)
+int main(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        std::ifstream in(argv[i], std::ios::binary);
+        const std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::printf("%s: %zu bytes\n", argv[i], data.size());
+        LLVMFuzzerTestOneInput(data.data(), data.size());
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,183 @@
+﻿// nes_input_latency - 量手柄输入从按键事件到画面的延迟
+//
+//   nes_input_latency [--presses N] [--mode direct|frame|both]
+//
+// 一个线程按随机间隔按下/松开 A 键，模拟线程按 60Hz 跑一段不停读 $4016 的小程序，
+// 每帧结束时（相当于呈现）检查程序看到的按键，变了就记下距按键事件的时间。
+//   direct: 按键写进 InputState，游戏读端口的那一刻取（现在的做法）
+//   frame:  界面线程每帧扫描一次键盘，模拟线程在帧开始时锁存（原来的做法）
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "controller.h"
+#include "machine.h"
+
+using namespace nes;
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// NTSC 每秒约 60.1 帧
+constexpr auto FRAME_PERIOD = std::chrono::nanoseconds(16639267);
+
+void usage()
+{
+    std::fprintf(stderr, "usage: nes_input_latency [--presses N] [--mode direct|frame|both]\n");
+}
+
+// 不停地选通并读完 8 位 1P 手柄，把 A 键写到 $00。
+// 只用 LDA/AND/STA，避开 OLC6502 里还有问题的移位指令
+std::vector<uint8_t> pollProgram()
+{
+    std::vector<uint8_t> code = {
+        0xA9, 0x01, 0x8D, 0x16, 0x40,   // LDA #$01; STA $4016
+        0xA9, 0x00, 0x8D, 0x16, 0x40,   // LDA #$00; STA $4016
+        0xAD, 0x16, 0x40, 0x29, 0x01,   // LDA $4016; AND #$01
+        0x85, 0x01,                     // STA $01
+    };
+    for (int i = 0; i < 7; i++) {
+        code.insert(code.end(), { 0xAD, 0x16, 0x40 });                      // LDA $4016
+    }
+    code.insert(code.end(), { 0xA5, 0x01, 0x85, 0x00, 0x4C, 0x00, 0x80 });  // LDA $01; STA $00; JMP $8000
+    return code;
+}
+
+struct Result
+{
+    std::vector<double> latencies;  // 毫秒
+    size_t missed = 0;              // 下一次按键前都没显示出来
+};
+
+Result measure(bool direct, size_t presses)
+{
+    Machine m;
+    m.setRenderMode(RenderMode::RAM_ONLY);
+    m.setControllers(true);
+    const std::vector<uint8_t> code = pollProgram();
+    m.load(0x8000, code.data(), code.size());
+    m.setResetVector(0x8000);
+    m.reset();
+
+    InputState live;
+    // frame 模式下界面线程扫描到的按键
+    std::atomic<uint8_t> scanned{ 0 };
+    if (direct) {
+        m.controllers.connect(&live);
+    }
+
+    std::atomic<bool> done{ false };
+    Result result;
+
+    std::thread emu([&]
+    {
+        Clock::time_point deadline = Clock::now();
+        uint8_t shown = 0;
+        while (!done.load(std::memory_order_acquire)) {
+            if (!direct) {
+                m.controllers.setButtons(0, scanned.load(std::memory_order_acquire));
+            }
+            m.runFrames(1);
+            const uint8_t now = m.bus->ram[0x0000] & BUTTON_A;
+            if (now != shown) {
+                const uint64_t sample = live.sample(0);
+                if ((InputState::buttons(sample) & BUTTON_A) == now) {
+                    result.latencies.push_back(InputState::elapsed(InputState::stamp(sample)) / 1e6);
+                }
+                shown = now;
+            }
+            deadline += FRAME_PERIOD;
+            std::this_thread::sleep_until(deadline);
+        }
+    });
+
+    // 界面帧和模拟帧的相位不相关
+    std::thread ui;
+    if (!direct) {
+        ui = std::thread([&]
+        {
+            Clock::time_point deadline = Clock::now() + FRAME_PERIOD / 3;
+            while (!done.load(std::memory_order_acquire)) {
+                std::this_thread::sleep_until(deadline);
+                scanned.store(InputState::buttons(live.sample(0)), std::memory_order_release);
+                deadline += FRAME_PERIOD;
+            }
+        });
+    }
+
+    // 间隔远大于两帧，上一次按键一定已经显示出来了
+    std::mt19937 rng(12345);
+    std::uniform_int_distribution<int> gap(60, 120);
+    for (size_t i = 0; i < presses; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(gap(rng)));
+        if (i % 2 == 0) {
+            live.press(0, BUTTON_A);
+        }
+        else {
+            live.release(0, BUTTON_A);
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    done.store(true, std::memory_order_release);
+    emu.join();
+    if (ui.joinable()) {
+        ui.join();
+    }
+    result.missed = presses - std::min(presses, result.latencies.size());
+    return result;
+}
+
+void report(const char* name, const Result& r)
+{
+    if (r.latencies.empty()) {
+        std::printf("%-7s no presses seen\n", name);
+        return;
+    }
+    std::vector<double> v = r.latencies;
+    std::sort(v.begin(), v.end());
+    double sum = 0.0;
+    for (double x : v) {
+        sum += x;
+    }
+    std::printf("%-7s %zu presses: mean %.2f ms, median %.2f ms, min %.2f ms, max %.2f ms, missed %zu\n",
+        name, v.size(), sum / v.size(), v[v.size() / 2], v.front(), v.back(), r.missed);
+}
+}
+
+int main(int argc, char* argv[])
+{
+    size_t presses = 30;
+    std::string mode = "both";
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 2;
+        }
+        else if (arg == "--presses") presses = std::strtoul(argv[++i], nullptr, 0);
+        else if (arg == "--mode") mode = argv[++i];
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (mode != "direct" && mode != "frame" && mode != "both") {
+        usage();
+        return 2;
+    }
+
+    if (mode != "frame") {
+        report("direct", measure(true, presses));
+    }
+    if (mode != "direct") {
+        report("frame", measure(false, presses));
+    }
+    return 0;
+}
@@ -0,0 +1,268 @@
+﻿// nes_lockstep - OLC6502 与参考实现逐指令对拍
+//
+// 每执行一条指令就比较两边的寄存器和这条指令产生的写操作序列，
+// 第一次出现差异时打印双方状态和反汇编后退出。
+//
+//   nes_lockstep <program> [--load-addr A] [--entry A] [--max-instructions N]
+//                [--cycles] [--strict-flags] [--trace FILE]
+//
+// 给出 --trace 时不跑参考实现，而是和录好的 nestest.log 格式的轨迹比较
+// 每条指令执行前的 PC 和寄存器。
+
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "machine.h"
+#include "ref6502.h"
+
+using namespace nes;
+
+namespace {
+struct Options
+{
+    std::string program;
+    uint16_t loadAddr = 0x8000;
+    std::optional<uint16_t> entry;
+    uint64_t maxInstructions = 10'000'000;
+    bool cycles = false;
+    bool strictFlags = false;
+    std::string trace;
+};
+
+struct Registers
+{
+    uint8_t a = 0, x = 0, y = 0, sp = 0, status = 0;
+    uint16_t pc = 0;
+};
+
+// 记录 OLC6502 一条指令内的全部写操作
+class WriteRecorder : public BusObserver {
+public:
+    void onWrite(uint16_t address, uint8_t data) override {
+        writes.push_back({ address, data });
+    }
+
+    std::vector<Ref6502::Write> writes;
+};
+
+Registers registersOf(const OLC6502& cpu)
+{
+    return { cpu.a, cpu.x, cpu.y, cpu.sp, cpu.status, cpu.pc };
+}
+
+Registers registersOf(const Ref6502& cpu)
+{
+    return { cpu.a, cpu.x, cpu.y, cpu.sp, cpu.status, cpu.pc };
+}
+
+void printRegisters(const char* who, const Registers& r)
+{
+    std::printf("  %-9s PC:%04X A:%02X X:%02X Y:%02X SP:%02X P:%02X\n", who, r.pc, r.a, r.x, r.y, r.sp, r.status);
+}
+
+void printWrites(const char* who, const std::vector<Ref6502::Write>& writes)
+{
+    std::printf("  %-9s writes:", who);
+    for (const auto& w : writes) {
+        std::printf(" [$%04X]=$%02X", w.address, w.data);
+    }
+    std::printf("%s\n", writes.empty() ? " (none)" : "");
+}
+
+bool sameRegisters(const Registers& l, const Registers& r, uint8_t flagMask)
+{
+    return l.a == r.a && l.x == r.x && l.y == r.y && l.sp == r.sp && l.pc == r.pc
+        && (l.status & flagMask) == (r.status & flagMask);
+}
+
+std::string disassembleAt(OLC6502& cpu, uint16_t pc)
+{
+    const auto lines = cpu.disassemble(pc, 0);
+    const auto it = lines.find(pc);
+    return it != lines.end() ? it->second : std::string("?");
+}
+
+// nestest.log: "C000  4C F5 C5  JMP $C5F5    A:00 X:00 Y:00 P:24 SP:FD ..."
+bool parseTraceLine(const std::string& line, Registers& r)
+{
+    auto field = [&](const char* key, int& value) -> bool
+    {
+        const auto pos = line.find(key);
+        if (pos == std::string::npos) {
+            return false;
+        }
+        value = static_cast<int>(std::strtol(line.c_str() + pos + std::char_traits<char>::length(key), nullptr, 16));
+        return true;
+    };
+
+    if (line.size() < 4) {
+        return false;
+    }
+    int a, x, y, p, sp;
+    if (!field("A:", a) || !field("X:", x) || !field("Y:", y) || !field("P:", p) || !field("SP:", sp)) {
+        return false;
+    }
+    r.pc = static_cast<uint16_t>(std::strtol(line.substr(0, 4).c_str(), nullptr, 16));
+    r.a = static_cast<uint8_t>(a);
+    r.x = static_cast<uint8_t>(x);
+    r.y = static_cast<uint8_t>(y);
+    r.status = static_cast<uint8_t>(p);
+    r.sp = static_cast<uint8_t>(sp);
+    return true;
+}
+
+int runTrace(Machine& m, const Options& opt, uint8_t flagMask)
+{
+    std::ifstream in(opt.trace);
+    if (!in) {
+        std::fprintf(stderr, "can not open trace %s\n", opt.trace.c_str());
+        return 2;
+    }
+
+    std::string line;
+    uint64_t n = 0;
+    for (; n < opt.maxInstructions && std::getline(in, line); n++) {
+        Registers expected;
+        if (!parseTraceLine(line, expected)) {
+            continue;
+        }
+        const Registers actual = registersOf(m.cpu);
+        if (!sameRegisters(actual, expected, flagMask)) {
+            std::printf("divergence before instruction %llu\n", static_cast<unsigned long long>(n));
+            printRegisters("OLC6502", actual);
+            printRegisters("trace", expected);
+            std::printf("  OLC6502   %s\n", disassembleAt(m.cpu, actual.pc).c_str());
+            std::printf("  trace     %s\n", line.c_str());
+            return 1;
+        }
+        m.step();
+    }
+    std::printf("%llu instructions match the trace\n", static_cast<unsigned long long>(n));
+    return 0;
+}
+
+int runReference(Machine& m, const Options& opt, uint8_t flagMask)
+{
+    // 参考实现从 OLC6502 复位完成后的状态出发
+    Ref6502 ref;
+    ref.mem = m.bus->ram;
+    ref.a = m.cpu.a;
+    ref.x = m.cpu.x;
+    ref.y = m.cpu.y;
+    ref.sp = m.cpu.sp;
+    ref.pc = m.cpu.pc;
+    ref.status = m.cpu.status;
+
+    WriteRecorder recorder;
+    m.bus->observer = &recorder;
+    m.bus->setAllPageTraps(Bus::TRAP_WRITE);
+
+    for (uint64_t n = 0; n < opt.maxInstructions; n++) {
+        // 反汇编要建 map 和字符串，每条都做会拖慢整个循环，只留下指令字节，分叉时再反汇编
+        const Registers before = registersOf(m.cpu);
+        std::array<uint8_t, 3> bytes;
+        m.bus->peek(before.pc, bytes);
+
+        recorder.writes.clear();
+        const uint64_t c0 = m.cycleCount();
+        m.step();
+        const uint64_t olcCycles = m.cycleCount() - c0;
+        const int refCycles = ref.step();
+        if (refCycles == 0) {
+            std::printf("instruction %llu: reference does not implement opcode $%02X at $%04X, stopping\n",
+                static_cast<unsigned long long>(n), ref.mem[before.pc], before.pc);
+            m.bus->observer = nullptr;
+            return 2;
+        }
+
+        const Registers olc = registersOf(m.cpu);
+        const Registers exp = registersOf(ref);
+        const bool cyclesDiffer = opt.cycles && olcCycles != static_cast<uint64_t>(refCycles);
+        if (!sameRegisters(olc, exp, flagMask) || recorder.writes != ref.writes || cyclesDiffer) {
+            // 指令可能改写了自己，按执行前的字节反汇编
+            std::array<uint8_t, 3> now;
+            m.bus->peek(before.pc, now);
+            m.bus->poke(before.pc, bytes);
+            const std::string line = disassembleAt(m.cpu, before.pc);
+            m.bus->poke(before.pc, now);
+            std::printf("divergence at instruction %llu: %s\n", static_cast<unsigned long long>(n), line.c_str());
+            printRegisters("before", before);
+            printRegisters("OLC6502", olc);
+            printRegisters("reference", exp);
+            printWrites("OLC6502", recorder.writes);
+            printWrites("reference", ref.writes);
+            std::printf("  cycles    OLC6502 %llu, reference %d\n", static_cast<unsigned long long>(olcCycles), refCycles);
+            m.bus->observer = nullptr;
+            return 1;
+        }
+    }
+
+    m.bus->observer = nullptr;
+    std::printf("%llu instructions in lockstep\n", static_cast<unsigned long long>(opt.maxInstructions));
+    return 0;
+}
+
+uint64_t parseNumber(const char* s)
+{
+    if (s[0] == '$') {
+        return std::strtoull(s + 1, nullptr, 16);
+    }
+    return std::strtoull(s, nullptr, 0);
+}
+
+void usage()
+{
+    std::fprintf(stderr,
+        "usage: nes_lockstep <program> [--load-addr A] [--entry A] [--max-instructions N]\n"
+        "                    [--cycles] [--strict-flags] [--trace FILE]\n");
+}
+}
+
+int main(int argc, char* argv[])
+{
+    Options opt;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg.rfind("--", 0) != 0) opt.program = arg;
+        else if (arg == "--cycles") opt.cycles = true;
+        else if (arg == "--strict-flags") opt.strictFlags = true;
+        else if (!hasValue) {
+            usage();
+            return 2;
+        }
+        else if (arg == "--load-addr") opt.loadAddr = static_cast<uint16_t>(parseNumber(argv[++i]));
+        else if (arg == "--entry") opt.entry = static_cast<uint16_t>(parseNumber(argv[++i]));
+        else if (arg == "--max-instructions") opt.maxInstructions = parseNumber(argv[++i]);
+        else if (arg == "--trace") opt.trace = argv[++i];
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (opt.program.empty()) {
+        usage();
+        return 2;
+    }
+
+    Machine m;
+    std::string error;
+    if (!m.loadFile(opt.program, opt.loadAddr, error)) {
+        std::fprintf(stderr, "%s: %s\n", opt.program.c_str(), error.c_str());
+        return 2;
+    }
+    if (opt.entry) {
+        m.setResetVector(*opt.entry);
+    }
+    m.reset();
+    m.step(); // 先跑完复位的周期
+
+    // B 和 U 只存在于压栈的副本里，默认不比较
+    const uint8_t flagMask = opt.strictFlags ? 0xFF : static_cast<uint8_t>(~(OLC6502::B | OLC6502::U));
+    return opt.trace.empty() ? runReference(m, opt, flagMask) : runTrace(m, opt, flagMask);
+}
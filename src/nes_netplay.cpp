@@ -0,0 +1,191 @@
+﻿// nes_netplay - 回滚联机的本机测试和计时
+//
+//   nes_netplay <program> [--load-addr A] [--frames N] [--transport loopback|udp]
+//               [--delay MS] [--port P]
+//
+// 两个玩家各用一台机器、一个线程，按 60Hz 推进，输入是按帧号确定的伪随机按键。
+// loopback 给每个包加 delay 毫秒的延迟，udp 走 127.0.0.1 的 port 和 port + 1。
+// 跑完后等双方输入全部确认，比较两台机器的存档是否一致，报告回滚次数和耗时；
+// 最后单独量一次恢复检查点加重放 MAX_ROLLBACK 帧的最坏情况，预算是 4 ms。
+// 不同步或者最坏情况超出预算时返回 1。
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "machine.h"
+#include "netplay.h"
+
+using namespace nes;
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// NTSC 每秒约 60.1 帧
+constexpr auto FRAME_PERIOD = std::chrono::nanoseconds(16639267);
+constexpr double ROLLBACK_BUDGET = 4000.0;
+
+void usage()
+{
+    std::fprintf(stderr, "usage: nes_netplay <program> [--load-addr A] [--frames N] [--transport loopback|udp] [--delay MS] [--port P]\n");
+}
+
+// 每 6 帧换一次按键，两个玩家不同，和在哪一帧停下来等无关
+uint8_t inputFor(size_t player, uint32_t frame)
+{
+    uint32_t x = static_cast<uint32_t>(frame / 6) * 2654435761u + static_cast<uint32_t>(player) * 40503u;
+    x ^= x >> 15;
+    x *= 2246822519u;
+    x ^= x >> 13;
+    return static_cast<uint8_t>(x);
+}
+
+void play(Machine& m, Transport& transport, size_t player, uint32_t frames, RollbackSession::Stats& stats, bool& synced)
+{
+    RollbackSession session(m, transport, player);
+    Clock::time_point deadline = Clock::now();
+    while (session.frame() < frames) {
+        session.advanceFrame(inputFor(player, session.frame()));
+        deadline += FRAME_PERIOD;
+        std::this_thread::sleep_until(deadline);
+    }
+    // 对方的输入全部到齐，最后一次回滚之后两边的状态应该完全一样
+    const Clock::time_point giveUp = Clock::now() + std::chrono::seconds(2);
+    while (session.confirmedFrames() < frames && Clock::now() < giveUp) {
+        session.poll();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    // 再发几次，免得对方还缺最后几帧
+    for (int i = 0; i < 10; i++) {
+        session.poll();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    stats = session.stats();
+    synced = session.confirmedFrames() >= frames;
+}
+
+void report(size_t player, const RollbackSession::Stats& s)
+{
+    std::printf("player %zu: %llu rollbacks, %llu frames re-simulated, longest %u frames, mean %.1f us, max %.1f us, %llu stalls\n",
+        player + 1, static_cast<unsigned long long>(s.rollbacks), static_cast<unsigned long long>(s.resimulated),
+        s.longestRollback, s.rollbacks ? s.totalRollbackMicros / s.rollbacks : 0.0, s.maxRollbackMicros,
+        static_cast<unsigned long long>(s.stalls));
+}
+
+// 恢复检查点再不出画面地重放 MAX_ROLLBACK 帧，最慢的一次在预算之内时返回 true
+bool worstCase(Machine& m)
+{
+    auto checkpoint = std::make_unique<Machine::Checkpoint>();
+    m.setRenderMode(RenderMode::RAM_ONLY);
+    double total = 0.0;
+    double worst = 0.0;
+    const int reps = 50;
+    for (int i = 0; i < reps; i++) {
+        m.saveCheckpoint(*checkpoint);
+        m.runFrames(RollbackSession::MAX_ROLLBACK);
+        const Clock::time_point t0 = Clock::now();
+        m.loadCheckpoint(*checkpoint);
+        m.runFrames(RollbackSession::MAX_ROLLBACK);
+        const double us = std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+        total += us;
+        worst = std::max(worst, us);
+    }
+    std::printf("restore + %u frames: mean %.1f us, max %.1f us (budget %.0f us) %s\n", RollbackSession::MAX_ROLLBACK,
+        total / reps, worst, ROLLBACK_BUDGET, worst <= ROLLBACK_BUDGET ? "OK" : "OVER");
+    return worst <= ROLLBACK_BUDGET;
+}
+}
+
+int main(int argc, char* argv[])
+{
+    std::string program;
+    uint16_t loadAddr = 0x8000;
+    uint32_t frames = 300;
+    std::string transportName = "loopback";
+    long delayMs = 30;
+    uint16_t port = 47000;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            program = arg;
+        }
+        else if (i + 1 >= argc) {
+            usage();
+            return 2;
+        }
+        else if (arg == "--load-addr") loadAddr = static_cast<uint16_t>(std::strtoul(argv[++i], nullptr, 0));
+        else if (arg == "--frames") frames = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+        else if (arg == "--transport") transportName = argv[++i];
+        else if (arg == "--delay") delayMs = std::strtol(argv[++i], nullptr, 0);
+        else if (arg == "--port") port = static_cast<uint16_t>(std::strtoul(argv[++i], nullptr, 0));
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (program.empty() || (transportName != "loopback" && transportName != "udp")) {
+        usage();
+        return 2;
+    }
+
+    auto boot = std::make_unique<Machine>();
+    std::string error;
+    if (!boot->loadFile(program, loadAddr, error)) {
+        std::fprintf(stderr, "%s: %s\n", program.c_str(), error.c_str());
+        return 1;
+    }
+    boot->reset();
+    auto start = std::make_unique<Machine::Snapshot>();
+    boot->saveSnapshot(*start);
+
+    std::unique_ptr<Transport> ends[2];
+    if (transportName == "loopback") {
+        std::unique_ptr<LoopbackTransport> a;
+        std::unique_ptr<LoopbackTransport> b;
+        LoopbackTransport::makePair(a, b, std::chrono::milliseconds(delayMs));
+        ends[0] = std::move(a);
+        ends[1] = std::move(b);
+    }
+    else {
+        auto a = std::make_unique<UdpTransport>();
+        auto b = std::make_unique<UdpTransport>();
+        if (!a->open(port, static_cast<uint16_t>(port + 1), error) || !b->open(static_cast<uint16_t>(port + 1), port, error)) {
+            std::fprintf(stderr, "udp: %s\n", error.c_str());
+            return 1;
+        }
+        ends[0] = std::move(a);
+        ends[1] = std::move(b);
+    }
+
+    std::unique_ptr<Machine> machines[2] = { std::make_unique<Machine>(), std::make_unique<Machine>() };
+    RollbackSession::Stats stats[2];
+    bool synced[2] = { false, false };
+    std::vector<std::thread> players;
+    for (size_t p = 0; p < 2; p++) {
+        machines[p]->loadSnapshot(*start);
+        machines[p]->setRenderMode(RenderMode::RAM_ONLY);
+        players.emplace_back(play, std::ref(*machines[p]), std::ref(*ends[p]), p, frames, std::ref(stats[p]), std::ref(synced[p]));
+    }
+    for (std::thread& t : players) {
+        t.join();
+    }
+
+    for (size_t p = 0; p < 2; p++) {
+        report(p, stats[p]);
+    }
+
+    std::vector<uint8_t> a(Machine::stateSize());
+    std::vector<uint8_t> b(Machine::stateSize());
+    machines[0]->saveState(a.data(), a.size());
+    machines[1]->saveState(b.data(), b.size());
+    const bool same = synced[0] && synced[1] && a == b;
+    std::printf("%u frames, %s\n", frames, !synced[0] || !synced[1] ? "inputs never fully confirmed" : same ? "in sync" : "DESYNC");
+
+    const bool inBudget = worstCase(*machines[0]);
+    return same && inBudget ? 0 : 1;
+}
@@ -0,0 +1,402 @@
+﻿// nes_regress - 并行运行一个目录下的所有测试程序
+//
+// 每个测试程序在自己的 Machine 上运行，通过结果字节或陷阱 PC 判断通过/失败，
+// 超过周期上限判为超时。结果输出为 JSON 和/或 JUnit XML。
+//
+//   nes_regress <dir> [--load-addr A] [--entry A] [--result-addr A]
+//               [--pass-value V] [--running-value V] [--success-pc A]
+//               [--max-cycles N] [--threads N] [--json FILE] [--junit FILE]
+//               [--hashes FILE] [--write-hashes FILE]
+//               [--render full|ram] [--verify-render] [--cdl DIR]
+//
+// 测试名（报告和哈希文件里）是相对 dir 的路径，不同子目录里的同名文件互不影响。
+// .bin 文件原样装入 load-addr（64K 的镜像从 $0000 开始装入），
+// .nes 文件跳过 iNES 头，PRG 装入 $8000（16K 的镜像到 $C000）。
+// 默认只跑 CPU 不生成画面；--verify-render 会再用完整渲染跑一遍，
+// 两次结束时的状态哈希不一致就判为失败。
+// --cdl 把每个程序运行结束时的代码/数据记录按 FCEUX 格式写到 DIR 下同样的相对路径（扩展名 .cdl），
+// 需要用 -DNES_CDL=ON 构建，否则直接报错退出。
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "machine.h"
+#include "parallel.h"
+
+using namespace nes;
+namespace fs = std::filesystem;
+
+namespace {
+struct Options
+{
+    fs::path dir;
+    uint16_t loadAddr = 0x8000;
+    std::optional<uint16_t> entry;
+    std::optional<uint16_t> resultAddr = 0x6000;
+    uint8_t passValue = 0x00;
+    uint8_t runningValue = 0x80;
+    std::optional<uint16_t> successPc;
+    uint64_t maxCycles = 50'000'000;
+    unsigned threads = 0;
+    std::string json;
+    std::string junit;
+    std::string hashes;
+    std::string writeHashes;
+    RenderMode render = RenderMode::RAM_ONLY;
+    bool verifyRender = false;
+    fs::path cdlDir;
+};
+
+enum class Status : uint8_t { PASS, FAIL, TIMEOUT, ERROR };
+
+const char* statusName(Status s)
+{
+    switch (s) {
+    case Status::PASS: return "pass";
+    case Status::FAIL: return "fail";
+    case Status::TIMEOUT: return "timeout";
+    default: return "error";
+    }
+}
+
+struct Result
+{
+    std::string name;
+    Status status = Status::ERROR;
+    std::string message;
+    uint64_t cycles = 0;
+    uint16_t pc = 0;
+    uint8_t result = 0;
+    uint64_t hash = 0;
+    double seconds = 0.0;
+};
+
+// 运行结束时 RAM 和寄存器的 FNV-1a 哈希，用来和历史结果对比
+uint64_t stateHash(const Machine& m)
+{
+    uint64_t h = 0xCBF29CE484222325ULL;
+    auto mix = [&h](uint8_t b)
+    {
+        h ^= b;
+        h *= 0x100000001B3ULL;
+    };
+    for (auto b : m.bus->ram) {
+        mix(b);
+    }
+    mix(m.cpu.a); mix(m.cpu.x); mix(m.cpu.y); mix(m.cpu.sp); mix(m.cpu.status);
+    mix(m.cpu.pc & 0xFF); mix(m.cpu.pc >> 8);
+    return h;
+}
+
+Result runOne(const fs::path& file, const Options& opt, RenderMode render)
+{
+    Result r;
+    r.name = fs::relative(file, opt.dir).generic_string();
+    const auto t0 = std::chrono::steady_clock::now();
+
+    auto m = std::make_unique<Machine>();
+    m->setRenderMode(render);
+    if (!m->loadFile(file.string(), opt.loadAddr, r.message)) {
+        r.status = Status::ERROR;
+        return r;
+    }
+    if (opt.entry) {
+        m->setResetVector(*opt.entry);
+    }
+    m->reset();
+    m->step(); // 先跑完复位的周期
+
+    bool running = false;
+    r.status = Status::TIMEOUT;
+    while (m->cycleCount() < opt.maxCycles) {
+        const uint16_t pc = m->cpu.pc;
+        m->step();
+
+        if (opt.resultAddr) {
+            const uint8_t v = m->bus->ram[*opt.resultAddr];
+            if (v == opt.runningValue) {
+                running = true;
+            }
+            else if (running) {
+                r.result = v;
+                r.status = v == opt.passValue ? Status::PASS : Status::FAIL;
+                if (r.status == Status::FAIL) {
+                    char buf[32];
+                    std::snprintf(buf, sizeof(buf), "result byte $%02X", v);
+                    r.message = buf;
+                }
+                break;
+            }
+        }
+
+        // 指令执行完 PC 没动，说明程序停在了 JMP * / 跳到自身的分支上
+        if (m->cpu.pc == pc) {
+            if (opt.successPc && pc == *opt.successPc) {
+                r.status = Status::PASS;
+            }
+            else {
+                r.status = Status::FAIL;
+                char buf[32];
+                std::snprintf(buf, sizeof(buf), "trapped at $%04X", pc);
+                r.message = buf;
+            }
+            break;
+        }
+    }
+    if (r.status == Status::TIMEOUT) {
+        r.message = "no result after " + std::to_string(opt.maxCycles) + " cycles";
+    }
+
+    r.cycles = m->cycleCount();
+    r.pc = m->cpu.pc;
+    r.hash = stateHash(*m);
+
+    // --verify-render 的第二遍不再写
+    if (!opt.cdlDir.empty() && render == opt.render) {
+        fs::path out = opt.cdlDir / fs::relative(file, opt.dir);
+        out.replace_extension(".cdl");
+        std::error_code ec;
+        fs::create_directories(out.parent_path(), ec);
+        std::string error;
+        if (!m->saveCdl(out.string(), error)) {
+            r.status = Status::ERROR;
+            r.message = "cdl: " + error;
+        }
+    }
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return r;
+}
+
+std::string escape(const std::string& s, bool xml)
+{
+    std::string out;
+    for (char c : s) {
+        switch (c) {
+        case '"': out += xml ? "&quot;" : "\\\""; break;
+        case '\\': out += xml ? "\\" : "\\\\"; break;
+        case '<': out += xml ? "&lt;" : "<"; break;
+        case '>': out += xml ? "&gt;" : ">"; break;
+        case '&': out += xml ? "&amp;" : "&"; break;
+        default: out += c; break;
+        }
+    }
+    return out;
+}
+
+std::string hex64(uint64_t v)
+{
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(v));
+    return buf;
+}
+
+Result runChecked(const fs::path& file, const Options& opt)
+{
+    Result r = runOne(file, opt, opt.render);
+    if (!opt.verifyRender || r.status == Status::ERROR) {
+        return r;
+    }
+    const RenderMode other = opt.render == RenderMode::FULL ? RenderMode::RAM_ONLY : RenderMode::FULL;
+    const Result check = runOne(file, opt, other);
+    if (check.hash != r.hash || check.cycles != r.cycles) {
+        r.status = Status::FAIL;
+        r.message = "render mode changed state: " + hex64(r.hash) + " != " + hex64(check.hash);
+    }
+    return r;
+}
+
+void writeJson(const std::string& path, const Options& opt, const std::vector<Result>& results, double seconds)
+{
+    std::ofstream out(path);
+    size_t passed = 0;
+    for (const auto& r : results) {
+        passed += r.status == Status::PASS;
+    }
+    out << "{\n  \"suite\": \"" << escape(opt.dir.string(), false) << "\",\n"
+        << "  \"total\": " << results.size() << ",\n"
+        << "  \"passed\": " << passed << ",\n"
+        << "  \"seconds\": " << seconds << ",\n"
+        << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const auto& r = results[i];
+        out << "    { \"name\": \"" << escape(r.name, false) << "\", \"status\": \"" << statusName(r.status)
+            << "\", \"message\": \"" << escape(r.message, false) << "\", \"cycles\": " << r.cycles
+            << ", \"pc\": " << r.pc << ", \"result\": " << static_cast<int>(r.result)
+            << ", \"hash\": \"" << hex64(r.hash) << "\", \"seconds\": " << r.seconds << " }"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+void writeJUnit(const std::string& path, const Options& opt, const std::vector<Result>& results, double seconds)
+{
+    std::ofstream out(path);
+    size_t failures = 0, errors = 0;
+    for (const auto& r : results) {
+        failures += r.status == Status::FAIL || r.status == Status::TIMEOUT;
+        errors += r.status == Status::ERROR;
+    }
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        << "<testsuite name=\"" << escape(opt.dir.filename().string(), true) << "\" tests=\"" << results.size()
+        << "\" failures=\"" << failures << "\" errors=\"" << errors << "\" time=\"" << seconds << "\">\n";
+    for (const auto& r : results) {
+        out << "  <testcase classname=\"nes_regress\" name=\"" << escape(r.name, true) << "\" time=\"" << r.seconds << "\"";
+        if (r.status == Status::PASS) {
+            out << "/>\n";
+            continue;
+        }
+        const char* tag = r.status == Status::ERROR ? "error" : "failure";
+        out << ">\n    <" << tag << " type=\"" << statusName(r.status) << "\" message=\"" << escape(r.message, true)
+            << "\"/>\n  </testcase>\n";
+    }
+    out << "</testsuite>\n";
+}
+
+// 每行 "<相对路径> <哈希>"，路径里可以有空格，哈希是最后一个字段
+std::map<std::string, uint64_t> readHashes(const std::string& path)
+{
+    std::map<std::string, uint64_t> hashes;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        const size_t space = line.find_last_of(' ');
+        if (space == std::string::npos || space == 0) {
+            continue;
+        }
+        hashes[line.substr(0, space)] = std::strtoull(line.c_str() + space + 1, nullptr, 16);
+    }
+    return hashes;
+}
+
+uint64_t parseNumber(const char* s)
+{
+    if (s[0] == '$') {
+        return std::strtoull(s + 1, nullptr, 16);
+    }
+    return std::strtoull(s, nullptr, 0);
+}
+
+void usage()
+{
+    std::fprintf(stderr,
+        "usage: nes_regress <dir> [--load-addr A] [--entry A] [--result-addr A|none]\n"
+        "                   [--pass-value V] [--running-value V] [--success-pc A]\n"
+        "                   [--max-cycles N] [--threads N] [--json FILE] [--junit FILE]\n"
+        "                   [--hashes FILE] [--write-hashes FILE]\n"
+        "                   [--render full|ram] [--verify-render] [--cdl DIR]\n");
+}
+}
+
+int main(int argc, char* argv[])
+{
+    Options opt;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg.rfind("--", 0) != 0) {
+            opt.dir = arg;
+        }
+        else if (arg == "--verify-render") {
+            opt.verifyRender = true;
+        }
+        else if (!hasValue) {
+            usage();
+            return 2;
+        }
+        else if (arg == "--load-addr") opt.loadAddr = static_cast<uint16_t>(parseNumber(argv[++i]));
+        else if (arg == "--entry") opt.entry = static_cast<uint16_t>(parseNumber(argv[++i]));
+        else if (arg == "--result-addr") {
+            const std::string v = argv[++i];
+            if (v == "none") opt.resultAddr.reset();
+            else opt.resultAddr = static_cast<uint16_t>(parseNumber(v.c_str()));
+        }
+        else if (arg == "--pass-value") opt.passValue = static_cast<uint8_t>(parseNumber(argv[++i]));
+        else if (arg == "--running-value") opt.runningValue = static_cast<uint8_t>(parseNumber(argv[++i]));
+        else if (arg == "--success-pc") opt.successPc = static_cast<uint16_t>(parseNumber(argv[++i]));
+        else if (arg == "--max-cycles") opt.maxCycles = parseNumber(argv[++i]);
+        else if (arg == "--threads") opt.threads = static_cast<unsigned>(parseNumber(argv[++i]));
+        else if (arg == "--json") opt.json = argv[++i];
+        else if (arg == "--junit") opt.junit = argv[++i];
+        else if (arg == "--hashes") opt.hashes = argv[++i];
+        else if (arg == "--write-hashes") opt.writeHashes = argv[++i];
+        else if (arg == "--cdl") opt.cdlDir = argv[++i];
+        else if (arg == "--render") {
+            const std::string v = argv[++i];
+            if (v == "full") opt.render = RenderMode::FULL;
+            else if (v == "ram") opt.render = RenderMode::RAM_ONLY;
+            else {
+                usage();
+                return 2;
+            }
+        }
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (opt.dir.empty() || !fs::is_directory(opt.dir)) {
+        usage();
+        return 2;
+    }
+#if !NES_CDL
+    if (!opt.cdlDir.empty()) {
+        std::fprintf(stderr, "--cdl needs a build with the code/data log, rebuild with -DNES_CDL=ON\n");
+        return 2;
+    }
+#endif
+
+    std::vector<fs::path> files;
+    for (const auto& entry : fs::recursive_directory_iterator(opt.dir)) {
+        const auto ext = entry.path().extension();
+        if (entry.is_regular_file() && (ext == ".bin" || ext == ".nes")) {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+
+    const auto t0 = std::chrono::steady_clock::now();
+    std::vector<Result> results(files.size());
+    parallelFor(files.size(), [&](size_t i) { results[i] = runChecked(files[i], opt); }, opt.threads);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    if (!opt.hashes.empty()) {
+        const auto expected = readHashes(opt.hashes);
+        for (auto& r : results) {
+            const auto it = expected.find(r.name);
+            if (r.status == Status::PASS && it != expected.end() && it->second != r.hash) {
+                r.status = Status::FAIL;
+                r.message = "state hash " + hex64(r.hash) + " != " + hex64(it->second);
+            }
+        }
+    }
+    if (!opt.writeHashes.empty()) {
+        std::ofstream out(opt.writeHashes);
+        for (const auto& r : results) {
+            out << r.name << " " << hex64(r.hash) << "\n";
+        }
+    }
+
+    size_t passed = 0;
+    for (const auto& r : results) {
+        passed += r.status == Status::PASS;
+        if (r.status != Status::PASS) {
+            std::printf("%-8s %s: %s\n", statusName(r.status), r.name.c_str(), r.message.c_str());
+        }
+    }
+    std::printf("%zu/%zu passed in %.3fs\n", passed, results.size(), seconds);
+
+    if (!opt.json.empty()) {
+        writeJson(opt.json, opt, results, seconds);
+    }
+    if (!opt.junit.empty()) {
+        writeJUnit(opt.junit, opt, results, seconds);
+    }
+    return passed == results.size() ? 0 : 1;
+}
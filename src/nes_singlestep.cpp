@@ -0,0 +1,471 @@
+﻿// nes_singlestep - 批量运行 SingleStepTests 格式的逐指令测试向量
+//
+// 目录里每个操作码一个 JSON 文件（"a9.json"），每个文件约一万个用例:
+//   { "name": "...", "initial": { "pc", "s", "a", "x", "y", "p", "ram": [[addr, val], ...] },
+//     "final": { ... }, "cycles": [[addr, val, "read"], ...] }
+// 检查执行一条指令后的寄存器、RAM 和周期数（cycles 数组的长度）。
+//
+//   nes_singlestep <dir> [--opcode XX] [--all] [--threads N] [--batch N]
+//
+// 默认只跑 lookup 表里的官方指令，--all 连非官方指令一起跑。
+// 文件按批并行解析，同一批的全部用例再切块分给所有核心执行。
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "machine.h"
+#include "parallel.h"
+
+using namespace nes;
+namespace fs = std::filesystem;
+
+namespace {
+constexpr size_t CASES_PER_TASK = 256;
+
+struct RamEntry
+{
+    uint16_t address;
+    uint8_t value;
+};
+
+struct CpuState
+{
+    uint16_t pc = 0;
+    uint8_t s = 0, a = 0, x = 0, y = 0, p = 0;
+    uint32_t ramBegin = 0;      // 在 TestFile::ram 里的下标
+    uint32_t ramCount = 0;
+};
+
+struct TestCase
+{
+    std::string_view name;      // 指向 TestFile::text
+    CpuState initial;
+    CpuState final;
+    uint32_t cycles = 0;
+};
+
+struct TestFile
+{
+    uint8_t opcode = 0;
+    std::string text;
+    std::vector<TestCase> cases;
+    std::vector<RamEntry> ram;
+    std::string error;
+};
+
+// 只认测试向量用到的那部分 JSON，直接在文件缓冲上走，不建 DOM，
+// 字符串都是指回缓冲区的 string_view
+class JsonCursor {
+public:
+    explicit JsonCursor(std::string_view text) : p(text.data()), end(text.data() + text.size()) {}
+
+    bool ok() const { return good; }
+
+    void ws() {
+        while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) {
+            p++;
+        }
+    }
+
+    bool peek(char c) {
+        ws();
+        return p < end && *p == c;
+    }
+
+    void expect(char c) {
+        ws();
+        if (p < end && *p == c) {
+            p++;
+        }
+        else {
+            good = false;
+            p = end;
+        }
+    }
+
+    // 列表分隔: 遇到 ',' 吃掉并返回 true，遇到 close 吃掉并返回 false
+    bool next(char close) {
+        ws();
+        if (p < end && *p == ',') {
+            p++;
+            return true;
+        }
+        expect(close);
+        return false;
+    }
+
+    uint32_t number() {
+        ws();
+        uint32_t v = 0;
+        const char* start = p;
+        while (p < end && *p >= '0' && *p <= '9') {
+            v = v * 10 + static_cast<uint32_t>(*p++ - '0');
+        }
+        if (p == start) {
+            good = false;
+            p = end;
+        }
+        return v;
+    }
+
+    std::string_view string() {
+        expect('"');
+        const char* start = p;
+        while (p < end && *p != '"') {
+            p += (*p == '\\') ? 2 : 1;
+        }
+        const std::string_view s(start, static_cast<size_t>(std::min(p, end) - start));
+        expect('"');
+        return s;
+    }
+
+    void skip() {
+        ws();
+        if (p >= end) {
+            good = false;
+            return;
+        }
+        if (*p == '"') {
+            string();
+        }
+        else if (*p == '[' || *p == '{') {
+            const char close = *p == '[' ? ']' : '}';
+            const bool object = *p == '{';
+            p++;
+            if (peek(close)) {
+                p++;
+                return;
+            }
+            do {
+                if (object) {
+                    string();
+                    expect(':');
+                }
+                skip();
+            } while (good && next(close));
+        }
+        else {
+            while (p < end && *p != ',' && *p != ']' && *p != '}') {
+                p++;
+            }
+        }
+    }
+
+private:
+    const char* p;
+    const char* end;
+    bool good = true;
+};
+
+void parseState(JsonCursor& json, CpuState& state, std::vector<RamEntry>& ram)
+{
+    json.expect('{');
+    do {
+        const std::string_view key = json.string();
+        json.expect(':');
+        if (key == "pc") state.pc = static_cast<uint16_t>(json.number());
+        else if (key == "s") state.s = static_cast<uint8_t>(json.number());
+        else if (key == "a") state.a = static_cast<uint8_t>(json.number());
+        else if (key == "x") state.x = static_cast<uint8_t>(json.number());
+        else if (key == "y") state.y = static_cast<uint8_t>(json.number());
+        else if (key == "p") state.p = static_cast<uint8_t>(json.number());
+        else if (key == "ram") {
+            state.ramBegin = static_cast<uint32_t>(ram.size());
+            json.expect('[');
+            if (!json.peek(']')) {
+                do {
+                    json.expect('[');
+                    const uint16_t address = static_cast<uint16_t>(json.number());
+                    json.expect(',');
+                    const uint8_t value = static_cast<uint8_t>(json.number());
+                    json.expect(']');
+                    ram.push_back({ address, value });
+                } while (json.ok() && json.next(']'));
+            }
+            else {
+                json.expect(']');
+            }
+            state.ramCount = static_cast<uint32_t>(ram.size()) - state.ramBegin;
+        }
+        else json.skip();
+    } while (json.ok() && json.next('}'));
+}
+
+uint32_t countArray(JsonCursor& json)
+{
+    uint32_t n = 0;
+    json.expect('[');
+    if (json.peek(']')) {
+        json.expect(']');
+        return 0;
+    }
+    do {
+        json.skip();
+        n++;
+    } while (json.ok() && json.next(']'));
+    return n;
+}
+
+bool readFile(const fs::path& path, std::string& text)
+{
+    std::FILE* f = std::fopen(path.string().c_str(), "rb");
+    if (f == nullptr) {
+        return false;
+    }
+    std::fseek(f, 0, SEEK_END);
+    const long size = std::ftell(f);
+    std::fseek(f, 0, SEEK_SET);
+    text.resize(size > 0 ? static_cast<size_t>(size) : 0);
+    const size_t got = std::fread(text.data(), 1, text.size(), f);
+    std::fclose(f);
+    return got == text.size();
+}
+
+void parseFile(const fs::path& path, TestFile& file)
+{
+    if (!readFile(path, file.text)) {
+        file.error = "can not read file";
+        return;
+    }
+
+    // 一个用例大约 1KB 文本，按此预留，避免反复扩容
+    file.cases.reserve(file.text.size() / 900 + 16);
+    file.ram.reserve(file.cases.capacity() * 16);
+
+    JsonCursor json(file.text);
+    json.expect('[');
+    if (json.peek(']')) {
+        return;
+    }
+    do {
+        TestCase tc;
+        json.expect('{');
+        do {
+            const std::string_view key = json.string();
+            json.expect(':');
+            if (key == "name") tc.name = json.string();
+            else if (key == "initial") parseState(json, tc.initial, file.ram);
+            else if (key == "final") parseState(json, tc.final, file.ram);
+            else if (key == "cycles") tc.cycles = countArray(json);
+            else json.skip();
+        } while (json.ok() && json.next('}'));
+        file.cases.push_back(tc);
+    } while (json.ok() && json.next(']'));
+
+    if (!json.ok()) {
+        file.error = "malformed JSON after case " + std::to_string(file.cases.size());
+    }
+}
+
+struct OpcodeResult
+{
+    std::atomic<uint32_t> passed { 0 };
+    std::atomic<uint32_t> failed { 0 };
+    std::mutex lock;
+    std::string firstFailure;
+};
+
+// 每个工作线程一台机器，用例之间只清掉上一个用例碰过的地址: 用例给出的初始内存，
+// 加上被测 CPU 实际写过的地址（挂在总线的 tracer 上记录，写错地址也能清掉）
+struct Worker : BusObserver
+{
+    Worker() { m.bus->tracer = this; }
+
+    void onWrite(uint16_t address, uint8_t) override { touched.push_back(address); }
+
+    Machine m;
+    std::vector<uint16_t> touched;
+};
+
+std::string describe(const TestCase& tc, const Machine& m, uint64_t cycles, const TestFile& file)
+{
+    char buf[512];
+    int n = std::snprintf(buf, sizeof(buf),
+        "%.*s\n    expected PC:%04X A:%02X X:%02X Y:%02X S:%02X P:%02X cycles:%u\n"
+        "    actual   PC:%04X A:%02X X:%02X Y:%02X S:%02X P:%02X cycles:%llu\n",
+        static_cast<int>(tc.name.size()), tc.name.data(),
+        tc.final.pc, tc.final.a, tc.final.x, tc.final.y, tc.final.s, tc.final.p, tc.cycles,
+        m.cpu.pc, m.cpu.a, m.cpu.x, m.cpu.y, m.cpu.sp, m.cpu.status, static_cast<unsigned long long>(cycles));
+    std::string s(buf, static_cast<size_t>(std::max(n, 0)));
+    for (uint32_t i = 0; i < tc.final.ramCount; i++) {
+        const RamEntry& e = file.ram[tc.final.ramBegin + i];
+        if (m.bus->ram[e.address] != e.value) {
+            std::snprintf(buf, sizeof(buf), "    [$%04X] expected $%02X actual $%02X\n", e.address, e.value, m.bus->ram[e.address]);
+            s += buf;
+        }
+    }
+    return s;
+}
+
+bool runCase(Worker& w, const TestFile& file, const TestCase& tc, OpcodeResult& result)
+{
+    Machine& m = w.m;
+    for (const uint16_t address : w.touched) {
+        m.bus->ram[address] = 0x00;
+    }
+    w.touched.clear();
+
+    for (uint32_t i = 0; i < tc.initial.ramCount; i++) {
+        const RamEntry& e = file.ram[tc.initial.ramBegin + i];
+        m.bus->ram[e.address] = e.value;
+        w.touched.push_back(e.address);
+    }
+
+    OLC6502::State state;
+    state.pc = tc.initial.pc;
+    state.sp = tc.initial.s;
+    state.a = tc.initial.a;
+    state.x = tc.initial.x;
+    state.y = tc.initial.y;
+    state.status = tc.initial.p;
+    m.cpu.loadState(state);
+    m.step();
+    const uint64_t cycles = m.cycleCount();
+
+    bool pass = m.cpu.pc == tc.final.pc && m.cpu.a == tc.final.a && m.cpu.x == tc.final.x
+        && m.cpu.y == tc.final.y && m.cpu.sp == tc.final.s && m.cpu.status == tc.final.p
+        && cycles == tc.cycles;
+    for (uint32_t i = 0; pass && i < tc.final.ramCount; i++) {
+        const RamEntry& e = file.ram[tc.final.ramBegin + i];
+        pass = m.bus->ram[e.address] == e.value;
+    }
+
+    if (pass) {
+        result.passed.fetch_add(1, std::memory_order_relaxed);
+    }
+    else if (result.failed.fetch_add(1, std::memory_order_relaxed) == 0) {
+        const std::string text = describe(tc, m, cycles, file);
+        std::lock_guard<std::mutex> guard(result.lock);
+        result.firstFailure = text;
+    }
+    return pass;
+}
+
+void usage()
+{
+    std::fprintf(stderr, "usage: nes_singlestep <dir> [--opcode XX] [--all] [--threads N] [--batch N]\n");
+}
+}
+
+int main(int argc, char* argv[])
+{
+    fs::path dir;
+    int onlyOpcode = -1;
+    bool all = false;
+    unsigned threads = 0;
+    size_t batch = 32;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg.rfind("--", 0) != 0) dir = arg;
+        else if (arg == "--all") all = true;
+        else if (arg == "--opcode" && hasValue) onlyOpcode = static_cast<int>(std::strtol(argv[++i], nullptr, 16));
+        else if (arg == "--threads" && hasValue) threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 0));
+        else if (arg == "--batch" && hasValue) batch = std::max<size_t>(1, std::strtoul(argv[++i], nullptr, 0));
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (dir.empty() || !fs::is_directory(dir)) {
+        usage();
+        return 2;
+    }
+
+    // 用 lookup 表判断哪些是官方指令
+    const Machine probe;
+    std::vector<std::pair<uint8_t, fs::path>> inputs;
+    for (int op = 0; op < 256; op++) {
+        if (onlyOpcode >= 0 && op != onlyOpcode) {
+            continue;
+        }
+        if (!all && probe.cpu.getInstructionName(static_cast<uint8_t>(op)) == "???") {
+            continue;
+        }
+        char name[16];
+        std::snprintf(name, sizeof(name), "%02x.json", op);
+        fs::path path = dir / name;
+        if (!fs::exists(path)) {
+            std::snprintf(name, sizeof(name), "%02X.json", op);
+            path = dir / name;
+        }
+        if (fs::exists(path)) {
+            inputs.emplace_back(static_cast<uint8_t>(op), path);
+        }
+    }
+    if (inputs.empty()) {
+        std::fprintf(stderr, "no test files found in %s\n", dir.string().c_str());
+        return 2;
+    }
+
+    if (threads == 0) {
+        threads = defaultThreadCount();
+    }
+    std::vector<Worker> workers(threads);
+    std::array<OpcodeResult, 256> results;
+    uint64_t total = 0;
+
+    const auto t0 = std::chrono::steady_clock::now();
+    for (size_t first = 0; first < inputs.size(); first += batch) {
+        const size_t count = std::min(batch, inputs.size() - first);
+
+        std::vector<TestFile> files(count);
+        parallelFor(count, [&](size_t i)
+        {
+            files[i].opcode = inputs[first + i].first;
+            parseFile(inputs[first + i].second, files[i]);
+        }, threads);
+
+        // 把这一批的全部用例切成小块，所有核心一起跑
+        std::vector<std::pair<uint32_t, uint32_t>> tasks;
+        for (uint32_t f = 0; f < count; f++) {
+            if (!files[f].error.empty()) {
+                std::printf("%s: %s\n", inputs[first + f].second.string().c_str(), files[f].error.c_str());
+            }
+            total += files[f].cases.size();
+            for (size_t c = 0; c < files[f].cases.size(); c += CASES_PER_TASK) {
+                tasks.emplace_back(f, static_cast<uint32_t>(c));
+            }
+        }
+
+        std::atomic<size_t> nextTask { 0 };
+        parallelFor(threads, [&](size_t t)
+        {
+            Worker& w = workers[t];
+            for (size_t i = nextTask.fetch_add(1); i < tasks.size(); i = nextTask.fetch_add(1)) {
+                const TestFile& file = files[tasks[i].first];
+                const size_t end = std::min<size_t>(file.cases.size(), tasks[i].second + CASES_PER_TASK);
+                for (size_t c = tasks[i].second; c < end; c++) {
+                    runCase(w, file, file.cases[c], results[file.opcode]);
+                }
+            }
+        }, threads);
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    uint64_t passed = 0;
+    unsigned opcodesFailed = 0;
+    for (const auto& [op, path] : inputs) {
+        const OpcodeResult& r = results[op];
+        passed += r.passed.load();
+        if (r.failed.load() > 0) {
+            opcodesFailed++;
+            std::printf("$%02X %-3s: %u/%u passed, first failure: %s", op,
+                probe.cpu.getInstructionName(op).c_str(), r.passed.load(), r.passed.load() + r.failed.load(),
+                r.firstFailure.c_str());
+        }
+    }
+    std::printf("%llu/%llu cases passed, %u/%zu opcodes with failures, %.2fs (%.0f cases/s)\n",
+        static_cast<unsigned long long>(passed), static_cast<unsigned long long>(total),
+        opcodesFailed, inputs.size(), seconds, seconds > 0 ? total / seconds : 0.0);
+    return passed == total ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+﻿// nes_trace - 查询最后是谁写了某个地址
+//
+//   nes_trace <program> --address A [--load-addr A] [--frames N] [--last N]
+//
+// 记录 frames 帧里的全部写操作，列出最近 last 条写 address 的指令（新的在前）。
+// 顺带自检: 最近一条记录的值要等于内存里的值；再恢复到中途的快照、重跑到同一个周期，
+// 轨迹要丢掉恢复点之后的旧记录并重新记录，两次的查询结果和记录总数要完全一样；
+// 最后再恢复一次、改走另一条时间线（写别的地址），旧时间线上的记录不能再出现。
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "machine.h"
+#include "write_trace.h"
+
+using namespace nes;
+
+namespace {
+void usage()
+{
+    std::fprintf(stderr, "usage: nes_trace <program> --address A [--load-addr A] [--frames N] [--last N]\n");
+}
+
+bool sameRecords(const std::vector<WriteTrace::Record>& a, const std::vector<WriteTrace::Record>& b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].cycle != b[i].cycle || a[i].pc != b[i].pc || a[i].address != b[i].address || a[i].value != b[i].value) {
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+int main(int argc, char* argv[])
+{
+    std::string program;
+    uint16_t loadAddr = 0x8000;
+    long address = -1;
+    uint32_t frames = 60;
+    size_t last = 10;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            program = arg;
+        }
+        else if (i + 1 >= argc) {
+            usage();
+            return 2;
+        }
+        else if (arg == "--address") address = std::strtol(argv[++i], nullptr, 0);
+        else if (arg == "--load-addr") loadAddr = static_cast<uint16_t>(std::strtoul(argv[++i], nullptr, 0));
+        else if (arg == "--frames") frames = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 0));
+        else if (arg == "--last") last = std::strtoul(argv[++i], nullptr, 0);
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (program.empty() || address < 0 || address > 0xFFFF || frames < 2) {
+        usage();
+        return 2;
+    }
+    const uint16_t target = static_cast<uint16_t>(address);
+
+    auto m = std::make_unique<Machine>();
+    std::string error;
+    if (!m->loadFile(program, loadAddr, error)) {
+        std::fprintf(stderr, "%s: %s\n", program.c_str(), error.c_str());
+        return 1;
+    }
+    m->setRenderMode(RenderMode::RAM_ONLY);
+    m->reset();
+
+    WriteTrace trace(*m);
+    trace.start();
+    m->runFrames(frames / 2);
+    auto middle = std::make_unique<Machine::Snapshot>();
+    m->saveSnapshot(*middle);
+    m->runFrames(frames - frames / 2);
+
+    const std::vector<WriteTrace::Record> writers = trace.lastWriters(target, last);
+    const uint64_t total = trace.size();
+    const uint64_t endCycle = m->cycleCount();
+    std::printf("%llu writes in %u frames, %zu chunks (%zu spilled)\n", static_cast<unsigned long long>(total), frames,
+        trace.chunkCount(), trace.spilledChunks());
+    std::printf("last %zu writers of $%04X:\n", writers.size(), target);
+    for (const WriteTrace::Record& r : writers) {
+        std::printf("  cycle %10llu  pc $%04X  value $%02X\n", static_cast<unsigned long long>(r.cycle), r.pc, r.value);
+    }
+
+    bool ok = true;
+    if (!writers.empty() && writers.front().value != m->bus->ram[target]) {
+        std::printf("FAIL: last writer stored $%02X but memory holds $%02X\n", writers.front().value, m->bus->ram[target]);
+        ok = false;
+    }
+
+    // 回到中途重跑，恢复点之后的记录要被替换而不是重复或保留
+    m->loadSnapshot(*middle);
+    if (!trace.writesInRange(middle->cpu.cycle_count, endCycle).empty()) {
+        std::printf("FAIL: records after the restore point are still visible\n");
+        ok = false;
+    }
+    m->runFrames(frames - frames / 2);
+    if (m->cycleCount() != endCycle || trace.size() != total || !sameRecords(trace.lastWriters(target, last), writers)) {
+        std::printf("FAIL: trace differs after restoring a snapshot and replaying (%llu writes)\n",
+            static_cast<unsigned long long>(trace.size()));
+        ok = false;
+    }
+
+    // 恢复之后马上写别的地址: 旧时间线上恢复点之后的写入都不能留下
+    const uint64_t restoreCycle = middle->cpu.cycle_count;
+    m->loadSnapshot(*middle);
+    const uint16_t other = static_cast<uint16_t>(target ^ 0x01);
+    m->bus->write(other, static_cast<uint8_t>(m->bus->ram[other] + 1));
+    const std::vector<WriteTrace::Record> diverged = trace.writesInRange(restoreCycle, endCycle);
+    if (diverged.size() != 1 || diverged.front().address != other) {
+        std::printf("FAIL: %zu records after the restore point on the new timeline, expected only the write to $%04X\n",
+            diverged.size(), other);
+        ok = false;
+    }
+    for (const WriteTrace::Record& r : trace.lastWriters(target, last)) {
+        if (r.cycle >= restoreCycle) {
+            std::printf("FAIL: write to $%04X at cycle %llu from the abandoned timeline is still reported\n", target,
+                static_cast<unsigned long long>(r.cycle));
+            ok = false;
+            break;
+        }
+    }
+    std::printf("%s\n", ok ? "self-check passed" : "self-check FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,274 @@
+﻿#include "netplay.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace nes {
+namespace {
+using Clock = std::chrono::steady_clock;
+
+constexpr uint8_t PACKET_MAGIC[2] = { 'N', 'P' };
+
+#if defined(_WIN32)
+using Socket = SOCKET;
+#else
+using Socket = int;
+#endif
+
+void putU32(uint8_t* p, uint32_t v)
+{
+    for (size_t i = 0; i < 4; i++) {
+        p[i] = static_cast<uint8_t>(v >> (i * 8));
+    }
+}
+
+uint32_t getU32(const uint8_t* p)
+{
+    uint32_t v = 0;
+    for (size_t i = 0; i < 4; i++) {
+        v |= static_cast<uint32_t>(p[i]) << (i * 8);
+    }
+    return v;
+}
+
+sockaddr_in loopbackAddress(uint16_t port)
+{
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return addr;
+}
+}
+
+void LoopbackTransport::makePair(std::unique_ptr<LoopbackTransport>& a, std::unique_ptr<LoopbackTransport>& b,
+    std::chrono::microseconds delay)
+{
+    a = std::make_unique<LoopbackTransport>();
+    b = std::make_unique<LoopbackTransport>();
+    a->inbox = b->outbox = std::make_shared<Queue>();
+    a->outbox = b->inbox = std::make_shared<Queue>();
+    a->delay = b->delay = delay;
+}
+
+void LoopbackTransport::send(const uint8_t* data, size_t len)
+{
+    std::lock_guard<std::mutex> guard(outbox->lock);
+    outbox->packets.push_back({ Clock::now() + delay, std::vector<uint8_t>(data, data + len) });
+}
+
+size_t LoopbackTransport::receive(uint8_t* data, size_t capacity)
+{
+    std::lock_guard<std::mutex> guard(inbox->lock);
+    if (inbox->packets.empty() || inbox->packets.front().due > Clock::now()) {
+        return 0;
+    }
+    const std::vector<uint8_t>& packet = inbox->packets.front().data;
+    const size_t n = std::min(packet.size(), capacity);
+    std::memcpy(data, packet.data(), n);
+    inbox->packets.pop_front();
+    return n;
+}
+
+UdpTransport::~UdpTransport()
+{
+    close();
+}
+
+bool UdpTransport::open(uint16_t localPort, uint16_t remotePort, std::string& error)
+{
+    close();
+#if defined(_WIN32)
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+        error = "WSAStartup failed";
+        return false;
+    }
+    const SOCKET s = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (s == INVALID_SOCKET) {
+        error = "can not create socket";
+        return false;
+    }
+    u_long nonBlocking = 1;
+    ioctlsocket(s, FIONBIO, &nonBlocking);
+#else
+    const int s = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (s < 0) {
+        error = "can not create socket";
+        return false;
+    }
+    ::fcntl(s, F_SETFL, ::fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+#endif
+    sock = static_cast<intptr_t>(s);
+
+    const sockaddr_in addr = loopbackAddress(localPort);
+    if (::bind(s, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+        error = "can not bind port " + std::to_string(localPort);
+        close();
+        return false;
+    }
+    remote_port = remotePort;
+    return true;
+}
+
+void UdpTransport::close()
+{
+    if (sock == -1) {
+        return;
+    }
+#if defined(_WIN32)
+    ::closesocket(static_cast<SOCKET>(sock));
+    WSACleanup();
+#else
+    ::close(static_cast<int>(sock));
+#endif
+    sock = -1;
+}
+
+void UdpTransport::send(const uint8_t* data, size_t len)
+{
+    if (sock == -1) {
+        return;
+    }
+    const sockaddr_in addr = loopbackAddress(remote_port);
+    // 发不出去（缓冲区满）就算丢包，协议本身会重发
+    ::sendto(static_cast<Socket>(sock), reinterpret_cast<const char*>(data),
+        static_cast<int>(len), 0, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+}
+
+size_t UdpTransport::receive(uint8_t* data, size_t capacity)
+{
+    if (sock == -1) {
+        return 0;
+    }
+    const auto n = ::recv(static_cast<Socket>(sock), reinterpret_cast<char*>(data),
+        static_cast<int>(capacity), 0);
+    return n > 0 ? static_cast<size_t>(n) : 0;
+}
+
+RollbackSession::RollbackSession(Machine& machine, Transport& transport, size_t player)
+    : machine(machine), transport(transport), local_port(player & 1), display_mode(machine.renderMode())
+{
+    // 两边的输入都由这里逐帧给出，不能再接实时的 InputState
+    machine.setControllers(true);
+    machine.controllers.connect(nullptr);
+}
+
+bool RollbackSession::advanceFrame(uint8_t buttons)
+{
+    receive();
+    rollback();
+
+    // 再往前跑就要预测超过 MAX_ROLLBACK 帧，等对方
+    if (current >= confirmed + MAX_ROLLBACK) {
+        statistics.stalls++;
+        sendInputs();
+        return false;
+    }
+
+    slots[current % RING].local = buttons;
+    runFrame(current, display_mode);
+    current++;
+    sendInputs();
+    return true;
+}
+
+void RollbackSession::poll()
+{
+    receive();
+    rollback();
+    sendInputs();
+}
+
+// 包: "NP"，u32 end，u8 count，然后是 [end - count, end) 这些帧的输入
+void RollbackSession::receive()
+{
+    uint8_t packet[PACKET_SIZE];
+    for (size_t n = transport.receive(packet, sizeof(packet)); n != 0; n = transport.receive(packet, sizeof(packet))) {
+        // 长度和 count 对不上的包（截断或损坏）整个丢掉，否则帧号会错位
+        if (n < 7 || packet[0] != PACKET_MAGIC[0] || packet[1] != PACKET_MAGIC[1] || n != 7 + static_cast<size_t>(packet[6])) {
+            continue;
+        }
+        const uint32_t end = getU32(packet + 2);
+        const uint32_t count = packet[6];
+        // 只按顺序接收，中间有缺口时等后面的包补上
+        for (uint32_t i = 0; i < count; i++) {
+            const uint32_t frame = end - count + i;
+            if (frame != confirmed) {
+                continue;
+            }
+            const uint8_t input = packet[7 + i];
+            Slot& slot = slots[frame % RING];
+            if (frame < current && slot.remote != input) {
+                mispredicted = std::min(mispredicted, frame);
+            }
+            slot.remote = input;
+            last_remote = input;
+            confirmed++;
+        }
+    }
+}
+
+void RollbackSession::rollback()
+{
+    if (mispredicted == UINT32_MAX) {
+        return;
+    }
+    const uint32_t from = mispredicted;
+    mispredicted = UINT32_MAX;
+
+    const Clock::time_point t0 = Clock::now();
+    machine.loadCheckpoint(*slots[from % RING].checkpoint);
+    for (uint32_t frame = from; frame < current; frame++) {
+        // 最后一帧要出画面，它就是当前显示的这一帧
+        runFrame(frame, frame + 1 == current ? display_mode : RenderMode::RAM_ONLY);
+    }
+    const double micros = std::chrono::duration<double, std::micro>(Clock::now() - t0).count();
+
+    statistics.rollbacks++;
+    statistics.resimulated += current - from;
+    statistics.longestRollback = std::max(statistics.longestRollback, current - from);
+    statistics.totalRollbackMicros += micros;
+    statistics.maxRollbackMicros = std::max(statistics.maxRollbackMicros, micros);
+}
+
+void RollbackSession::sendInputs()
+{
+    uint8_t packet[PACKET_SIZE];
+    const uint32_t count = std::min(current, RING);
+    packet[0] = PACKET_MAGIC[0];
+    packet[1] = PACKET_MAGIC[1];
+    putU32(packet + 2, current);
+    packet[6] = static_cast<uint8_t>(count);
+    for (uint32_t i = 0; i < count; i++) {
+        packet[7 + i] = slots[(current - count + i) % RING].local;
+    }
+    transport.send(packet, 7 + count);
+}
+
+void RollbackSession::runFrame(uint32_t frame, RenderMode mode)
+{
+    Slot& slot = slots[frame % RING];
+    machine.saveCheckpoint(*slot.checkpoint);
+    if (frame >= confirmed) {
+        slot.remote = last_remote;
+    }
+    machine.controllers.setButtons(local_port, slot.local);
+    machine.controllers.setButtons(local_port ^ 1, slot.remote);
+    machine.setRenderMode(mode);
+    machine.runFrames(1);
+    machine.setRenderMode(display_mode);
+}
+}
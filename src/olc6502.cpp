@@ -8,8 +8,8 @@
 namespace nes {
 void OLC6502::write(uint16_t address, uint8_t data)
 {
-    if (!bus.expired()) {
-        bus.lock()->write(address, data);
+    if (bus_ptr != nullptr) {
+        bus_ptr->write(address, data);
     }
     else {
         printf("Error: bus is nullptr!");
@@ -19,12 +19,20 @@ void OLC6502::write(uint16_t address, uint8_t data)
 
 uint8_t OLC6502::read(uint16_t address)
 {
-    if (!bus.expired()) {
-        return bus.lock()->read(address);
+    if (bus_ptr != nullptr) {
+#if NES_CDL
+        // 当前指令自身的字节按操作码/操作数标记，其他读取都算数据
+        const uint16_t offset = static_cast<uint16_t>(address - instruction_pc);
+        if (offset < instruction_bytes) {
+            return bus_ptr->fetch(address, offset == 0 ? Bus::CDL_OPCODE : Bus::CDL_OPERAND);
+        }
+#endif
+        return bus_ptr->read(address);
     }
     else {
         spdlog::error("Error: bus is nullptr!");
     }
+    return 0x00;
 }
 
 void OLC6502::reset()
@@ -49,6 +57,38 @@ void OLC6502::reset()
     cycles = 8;
 }
 
+OLC6502::State OLC6502::saveState() const
+{
+    State state;
+    state.a = a;
+    state.x = x;
+    state.y = y;
+    state.sp = sp;
+    state.pc = pc;
+    state.status = status;
+    state.addr_abs = addr_abs;
+    state.addr_rel = addr_rel;
+    state.opcode = opcode;
+    state.cycles = cycles;
+    state.cycle_count = cycle_count;
+    return state;
+}
+
+void OLC6502::loadState(const State& state)
+{
+    a = state.a;
+    x = state.x;
+    y = state.y;
+    sp = state.sp;
+    pc = state.pc;
+    status = state.status;
+    addr_abs = state.addr_abs;
+    addr_rel = state.addr_rel;
+    opcode = state.opcode;
+    cycles = state.cycles;
+    cycle_count = state.cycle_count;
+}
+
 void OLC6502::irq()
 {
     if (getFlag(I) == 0) {
@@ -798,6 +838,7 @@ uint8_t OLC6502::XXX()
 std::map<uint16_t, std::string> OLC6502::disassemble(uint16_t nStart, uint16_t len)
 {
     uint32_t addr = nStart;
+    const uint32_t nStop = static_cast<uint32_t>(nStart) + len;
     uint8_t value = 0x00;
     uint8_t lo = 0x00;
     uint8_t hi = 0x00;
@@ -807,16 +848,35 @@ std::map<uint16_t, std::string> OLC6502::disassemble(uint16_t nStart, uint16_t l
     auto hex = [](uint32_t n, uint8_t d) -> std::string
     {
         std::string s(d, '0');
-        for (auto i = d - 1; i >= 0, i--; n >>= 4) {
+        for (int i = d - 1; i >= 0; i--, n >>= 4) {
             s[i] = "0123456789ABCDEF"[n & 0xF];
         }
         return s;
     };
 
-    std::string sInst = "$" + hex(addr, 4) + ": ";
-    uint8_t opcode = 0;
-    if (!bus.expired()) {
-        uint8_t opcode = bus.lock()->read(addr); addr++;
+    const auto pBus = bus.lock();
+    if (!pBus) {
+        spdlog::error("bus point is expired!");
+        return mapLines;
+    }
+    // 地址超过 $FFFF 时回绕，和 CPU 取指一致。直接读 RAM，不触发读观察点
+    auto fetch = [&]() -> uint8_t
+    {
+        return pBus->ram[static_cast<uint16_t>(addr++)];
+    };
+
+    while (addr <= nStop) {
+        line_addr = static_cast<uint16_t>(addr);
+        std::string sInst = "$" + hex(addr & 0xFFFF, 4) + ": ";
+
+        // CDL 里只被当作数据读过、从没执行过的字节按数据输出，不再当指令解码
+        const uint8_t flags = pBus->cdlFlags(line_addr);
+        if ((flags & Bus::CDL_READ) && !(flags & (Bus::CDL_OPCODE | Bus::CDL_OPERAND))) {
+            mapLines[line_addr] = sInst + ".DB $" + hex(fetch(), 2);
+            continue;
+        }
+
+        const uint8_t opcode = fetch();
 
         sInst += lookup[opcode].name + " ";
         if (lookup[opcode].addrmode == &OLC6502::IMP)
@@ -825,81 +885,98 @@ std::map<uint16_t, std::string> OLC6502::disassemble(uint16_t nStart, uint16_t l
         }
         else if (lookup[opcode].addrmode == &OLC6502::IMM)
         {
-            value = bus.lock()->read(addr); addr++;
+            value = fetch();
             sInst += "#$" + hex(value, 2) + " {IMM}";
         }
         else if (lookup[opcode].addrmode == &OLC6502::ZP0)
         {
-            lo = bus.lock()->read(addr); addr++;
+            lo = fetch();
             hi = 0x00;
             sInst += "$" + hex(lo, 2) + " {ZP0}";
         }
         else if (lookup[opcode].addrmode == &OLC6502::ZPX)
         {
-            lo = bus.lock()->read(addr); addr++;
+            lo = fetch();
             hi = 0x00;
             sInst += "$" + hex(lo, 2) + ", X {ZPX}";
         }
         else if (lookup[opcode].addrmode == &OLC6502::ZPY)
         {
-            lo = bus.lock()->read(addr); addr++;
+            lo = fetch();
             hi = 0x00;
             sInst += "$" + hex(lo, 2) + ", Y {ZPY}";
         }
         else if (lookup[opcode].addrmode == &OLC6502::IZX)
         {
-            lo = bus.lock()->read(addr); addr++;
+            lo = fetch();
             hi = 0x00;
             sInst += "($" + hex(lo, 2) + ", X) {IZX}";
         }
         else if (lookup[opcode].addrmode == &OLC6502::IZY)
         {
-            lo = bus.lock()->read(addr); addr++;
+            lo = fetch();
             hi = 0x00;
             sInst += "($" + hex(lo, 2) + "), Y {IZY}";
         }
         else if (lookup[opcode].addrmode == &OLC6502::ABS)
         {
-            lo = bus.lock()->read(addr); addr++;
-            hi = bus.lock()->read(addr); addr++;
+            lo = fetch();
+            hi = fetch();
             sInst += "$" + hex((uint16_t)(hi << 8) | lo, 4) + " {ABS}";
         }
         else if (lookup[opcode].addrmode == &OLC6502::ABX)
         {
-            lo = bus.lock()->read(addr); addr++;
-            hi = bus.lock()->read(addr); addr++;
+            lo = fetch();
+            hi = fetch();
             sInst += "$" + hex((uint16_t)(hi << 8) | lo, 4) + ", X {ABX}";
         }
         else if (lookup[opcode].addrmode == &OLC6502::ABY)
         {
-            lo = bus.lock()->read(addr); addr++;
-            hi = bus.lock()->read(addr); addr++;
+            lo = fetch();
+            hi = fetch();
             sInst += "$" + hex((uint16_t)(hi << 8) | lo, 4) + ", Y {ABY}";
         }
         else if (lookup[opcode].addrmode == &OLC6502::IND)
         {
-            lo = bus.lock()->read(addr); addr++;
-            hi = bus.lock()->read(addr); addr++;
+            lo = fetch();
+            hi = fetch();
             sInst += "($" + hex((uint16_t)(hi << 8) | lo, 4) + ") {IND}";
         }
         else if (lookup[opcode].addrmode == &OLC6502::REL)
         {
-            value = bus.lock()->read(addr); addr++;
-            sInst += "$" + hex(value, 2) + " [$" + hex(addr + value, 4) + "] {REL}";
+            value = fetch();
+            // 偏移量是有符号数
+            const uint16_t target = static_cast<uint16_t>(addr + static_cast<int8_t>(value));
+            sInst += "$" + hex(value, 2) + " [$" + hex(target, 4) + "] {REL}";
         }
 
+        // Add the formed string to a std::map, using the instruction's
+        // address as the key. This makes it convenient to look for later
+        // as the instructions are variable in length, so a straight up
+        // incremental index is not sufficient.
+        mapLines[line_addr] = sInst;
     }
-    else {
-        spdlog::error("bus point is expired!");
-    }
-    // Add the formed string to a std::map, using the instruction's
-    // address as the key. This makes it convenient to look for later
-    // as the instructions are variable in length, so a straight up
-    // incremental index is not sufficient.
-    mapLines[line_addr] = sInst;
 
     return mapLines;
 }
+std::array<uint8_t, 256> OLC6502::instructionLengths() const
+{
+    std::array<uint8_t, 256> lengths{};
+    for (size_t i = 0; i < lookup.size(); i++) {
+        const auto mode = lookup[i].addrmode;
+        if (mode == &OLC6502::IMP) {
+            lengths[i] = 1;
+        }
+        else if (mode == &OLC6502::ABS || mode == &OLC6502::ABX || mode == &OLC6502::ABY || mode == &OLC6502::IND) {
+            lengths[i] = 3;
+        }
+        else {
+            lengths[i] = 2;
+        }
+    }
+    return lengths;
+}
+
 bool OLC6502::complete()
 {
     return cycles == 0;
@@ -907,7 +984,10 @@ bool OLC6502::complete()
 void OLC6502::clock()
 {
     if (cycles == 0) {
+        instruction_pc = pc;
+        instruction_bytes = 1;
         opcode = read(pc);
+        instruction_bytes = instruction_length[opcode];
         setFlag(Flag::U, true);
         pc++;
         const auto& instruction = lookup[opcode];
@@ -917,7 +997,8 @@ void OLC6502::clock()
         cycles += (additional_cycle1 & additional_cycle2); // 这里只表示两个操作是否影响了周期，影响了则周期+1，否则不变,后续优化实现TODO
         setFlag(Flag::U, true);
 
-        spdlog::info("cycle_count:{}, instruction:{}, cycles:{}, Register a:{}, x:{}, y:{}, status:{}; sp:{}, pc: {}",
+        // 逐条指令的跟踪日志，只在 SPDLOG_ACTIVE_LEVEL 设为 TRACE 时编译进来
+        SPDLOG_TRACE("cycle_count:{}, instruction:{}, cycles:{}, Register a:{}, x:{}, y:{}, status:{}; sp:{}, pc: {}",
             cycle_count, instruction.name, instruction.cycles, a, 
             x, y, status, sp, pc);
     }
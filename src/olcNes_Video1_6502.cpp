@@ -71,11 +71,22 @@
 	David Barr, aka javidx9, �OneLoneCoder 2019
 */
 
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <sstream>
 
 #include "bus.h"
-#include "OLC6502.h"
+#include "controller.h"
+#include "debugger.h"
+#include "emu_thread.h"
+#include "machine.h"
+#include "olc6502.h"
+#include "time_travel.h"
+#include "video_dump.h"
 
 #define OLC_PGE_APPLICATION
 #include "olcPixelGameEngine.h"
@@ -87,87 +98,201 @@ class Demo_OLC6502 : public olc::PixelGameEngine
 public:
 	Demo_OLC6502() { 
 		sAppName = "OLC6502 Demonstration"; 
-		cpu->connectBus(bus);
 	}
 
-	std::unique_ptr<OLC6502> cpu = std::make_unique<OLC6502>();
-	std::shared_ptr<Bus> bus = std::make_shared<Bus>();
-	std::map<uint16_t, std::string> mapAsm;
-
-	std::string hex(uint32_t n, uint8_t d)
-	{
-		std::string s(d, '0');
-		for (int i = d - 1; i >= 0; i--, n >>= 4)
-			s[i] = "0123456789ABCDEF"[n & 0xF];
-		return s;
-	};
-
-	void DrawRam(int x, int y, uint16_t nAddr, int nRows, int nColumns)
+	Machine machine;
+	OLC6502* const cpu = &machine.cpu;
+	std::shared_ptr<Bus> bus = machine.bus;
+	Debugger debugger{ machine };
+	TimeTravel history{ machine, debugger };
+	// 模拟在这个线程上跑，OnUserCreate 之后界面只通过它读写上面这些对象
+	EmuThread emu{ machine, debugger, history };
+	std::unique_ptr<VideoDump> dump;
+
+	// 1P 手柄: 按键事件直接写进这里，游戏读 $4016 时取，不等界面帧
+	InputState input;
+	// 延迟探针: 游戏锁存到新的按键后，量从按键事件到这一帧呈现的时间
+	bool bLatencyProbe = false;
+	uint64_t nProbeStamp = 0;
+
+	// 上一次画到屏幕上的状态；之后只重画和它不一样的面板/行，什么都没变时整帧跳过
+	EmuThread::State drawn{};
+	bool bDrawnValid = false;
+
+	// 大于 0 时跑完这么多帧就退出（无显示环境下用）
+	uint64_t nFrameLimit = 0;
+	uint64_t nFramesDone = 0;
+
+	// 调试视图的文字层: 先格式化进固定的 char 缓冲，再把字形按行从预先展开的位掩码写进画布。
+	// 每帧不分配内存，也不像 DrawString 那样逐像素 GetPixel / Draw、来回切换像素模式
+	uint8_t fontMask[96][8] = {};	// 每个字符 8 行，bit7 是最左边的像素
+	char hexDigits[256][2] = {};
+
+	void BuildTextTables()
 	{
-		int nRamX = x, nRamY = y;
-		for (int row = 0; row < nRows; row++)
-		{
-			std::string sOffset = "$" + hex(nAddr, 4) + ":";
-			for (int col = 0; col < nColumns; col++)
+		olc::Sprite* font = GetFontSprite();
+		for (int c = 0; c < 96; c++)
+			for (int j = 0; j < 8; j++)
 			{
-				sOffset += " " + hex(cpu->read(nAddr), 2);
-				nAddr += 1;
+				uint8_t bits = 0;
+				for (int i = 0; i < 8; i++)
+					if (font->GetPixel((c % 16) * 8 + i, (c / 16) * 8 + j).r > 0)
+						bits |= uint8_t(0x80 >> i);
+				fontMask[c][j] = bits;
 			}
-			DrawString(nRamX, nRamY, sOffset);
-			nRamY += 10;
+		for (int n = 0; n < 256; n++)
+		{
+			hexDigits[n][0] = "0123456789ABCDEF"[n >> 4];
+			hexDigits[n][1] = "0123456789ABCDEF"[n & 0xF];
 		}
 	}
 
-	void DrawCpu(int x, int y)
+	char* PutHex8(char* p, uint8_t n)
 	{
-		std::string status = "STATUS: ";
-		DrawString(x, y, "STATUS:", olc::WHITE);
-		DrawString(x + 64, y, "N", cpu->status & OLC6502::N ? olc::GREEN : olc::RED);
-		DrawString(x + 80, y, "V", cpu->status & OLC6502::V ? olc::GREEN : olc::RED);
-		DrawString(x + 96, y, "-", cpu->status & OLC6502::U ? olc::GREEN : olc::RED);
-		DrawString(x + 112, y, "B", cpu->status & OLC6502::B ? olc::GREEN : olc::RED);
-		DrawString(x + 128, y, "D", cpu->status & OLC6502::D ? olc::GREEN : olc::RED);
-		DrawString(x + 144, y, "I", cpu->status & OLC6502::I ? olc::GREEN : olc::RED);
-		DrawString(x + 160, y, "Z", cpu->status & OLC6502::Z ? olc::GREEN : olc::RED);
-		DrawString(x + 178, y, "C", cpu->status & OLC6502::C ? olc::GREEN : olc::RED);
-		DrawString(x, y + 10, "PC: $" + hex(cpu->pc, 4));
-		DrawString(x, y + 20, "A: $" + hex(cpu->a, 2) + "  [" + std::to_string(cpu->a) + "]");
-		DrawString(x, y + 30, "X: $" + hex(cpu->x, 2) + "  [" + std::to_string(cpu->x) + "]");
-		DrawString(x, y + 40, "Y: $" + hex(cpu->y, 2) + "  [" + std::to_string(cpu->y) + "]");
-		DrawString(x, y + 50, "Stack P: $" + hex(cpu->sp, 4));
+		p[0] = hexDigits[n][0];
+		p[1] = hexDigits[n][1];
+		return p + 2;
 	}
 
-	void DrawCode(int x, int y, int nLines)
+	char* PutHex16(char* p, uint16_t n)
 	{
-		auto it_a = mapAsm.find(cpu->pc);
-		int nLineY = (nLines >> 1) * 10 + y;
-		if (it_a != mapAsm.end())
+		return PutHex8(PutHex8(p, uint8_t(n >> 8)), uint8_t(n & 0xFF));
+	}
+
+	char* PutDec(char* p, uint8_t n)
+	{
+		if (n >= 100)
+			*p++ = char('0' + n / 100);
+		if (n >= 10)
+			*p++ = char('0' + n / 10 % 10);
+		*p++ = char('0' + n % 10);
+		return p;
+	}
+
+	char* PutStr(char* p, const char* s)
+	{
+		while (*s != '\0')
+			*p++ = *s++;
+		return p;
+	}
+
+	// 只支持不透明的颜色和 1 倍大小，调试视图用不到别的
+	void Text(int x, int y, const char* s, olc::Pixel col = olc::WHITE)
+	{
+		olc::Sprite* target = GetDrawTarget();
+		olc::Pixel* data = target->GetData();
+		const int w = target->width, h = target->height;
+		for (; *s != '\0'; s++, x += 8)
 		{
-			DrawString(x, nLineY, (*it_a).second, olc::CYAN);
-			while (nLineY < (nLines * 10) + y)
+			const int c = uint8_t(*s) - 32;
+			if (c < 0 || c >= 96 || x <= -8 || x >= w)
+				continue;
+			for (int j = 0; j < 8; j++)
 			{
-				nLineY += 10;
-				if (it_a != mapAsm.end())
-				{
-					DrawString(x, nLineY, (*it_a).second);
-					it_a++;
-				}
+				const int py = y + j;
+				const uint8_t bits = fontMask[c][j];
+				if (bits == 0 || py < 0 || py >= h)
+					continue;
+				olc::Pixel* row = data + py * w;
+				for (int i = 0; i < 8; i++)
+					if ((bits & (0x80 >> i)) && x + i >= 0 && x + i < w)
+						row[x + i] = col;
 			}
 		}
+	}
 
-		it_a = mapAsm.find(cpu->pc);
-		nLineY = (nLines >> 1) * 10 + y;
-		if (it_a != mapAsm.end())
+	// 从发布的状态里画一页内存（256 字节，16 行）；bAll 为 false 时只重画和 drawn 不同的行
+	bool DrawRam(int x, int y, const EmuThread::State& state, size_t nPage, bool bAll)
+	{
+		const std::array<uint8_t, 256>& data = state.pages[nPage];
+		const std::array<uint8_t, 256>& old = drawn.pages[nPage];
+		uint16_t nAddr = uint16_t(state.pageNumbers[nPage] << 8);
+		char line[8 + 16 * 3];
+		bool bDrew = false;
+		for (int row = 0; row < 16; row++, nAddr += 16)
 		{
-			while (nLineY > y)
+			if (!bAll && std::memcmp(&data[row * 16], &old[row * 16], 16) == 0)
+				continue;
+			char* p = line;
+			*p++ = '$';
+			p = PutHex16(p, nAddr);
+			*p++ = ':';
+			for (int col = 0; col < 16; col++)
 			{
-				nLineY -= 10;
-				if (--it_a != mapAsm.end())
-				{
-					DrawString(x, nLineY, (*it_a).second);
-				}
+				*p++ = ' ';
+				p = PutHex8(p, data[row * 16 + col]);
 			}
+			*p = '\0';
+			FillRect(x, y + row * 10, int(p - line) * 8, 8, olc::DARK_BLUE);
+			Text(x, y + row * 10, line);
+			bDrew = true;
 		}
+		return bDrew;
+	}
+
+	void DrawCpu(int x, int y, const EmuThread::State& state)
+	{
+		static const struct { int x; char name[2]; uint8_t flag; } flags[] = {
+			{ 64, "N", OLC6502::N }, { 80, "V", OLC6502::V }, { 96, "-", OLC6502::U }, { 112, "B", OLC6502::B },
+			{ 128, "D", OLC6502::D }, { 144, "I", OLC6502::I }, { 160, "Z", OLC6502::Z }, { 178, "C", OLC6502::C },
+		};
+		Text(x, y, "STATUS:");
+		for (const auto& f : flags)
+			Text(x + f.x, y, f.name, state.status & f.flag ? olc::GREEN : olc::RED);
+
+		char line[32];
+		char* p = PutHex16(PutStr(line, "PC: $"), state.pc);
+		*p = '\0';
+		Text(x, y + 10, line);
+
+		const struct { const char* label; uint8_t value; } regs[] = {
+			{ "A: $", state.a }, { "X: $", state.x }, { "Y: $", state.y },
+		};
+		for (int i = 0; i < 3; i++)
+		{
+			p = PutHex8(PutStr(line, regs[i].label), regs[i].value);
+			p = PutDec(PutStr(p, "  ["), regs[i].value);
+			*p++ = ']';
+			*p = '\0';
+			Text(x, y + 20 + i * 10, line);
+		}
+
+		p = PutHex16(PutStr(line, "Stack P: $"), state.sp);
+		*p = '\0';
+		Text(x, y + 50, line);
+	}
+
+	void DrawCode(int x, int y, const EmuThread::State& state)
+	{
+		// PC 所在行在正中间；设了断点的行标红
+		const size_t nCentre = EmuThread::CODE_LINES / 2;
+		for (size_t i = 0; i < EmuThread::CODE_LINES; i++)
+		{
+			const EmuThread::CodeLine& line = state.code[i];
+			if (line.text[0] == '\0')
+				continue;
+			olc::Pixel colour = line.breakpoint ? olc::RED : olc::WHITE;
+			if (i == nCentre)
+				colour = line.breakpoint ? olc::MAGENTA : olc::CYAN;
+			Text(x, y + int(i) * 10, line.text, colour);
+		}
+	}
+
+	static bool RegistersDiffer(const EmuThread::State& a, const EmuThread::State& b)
+	{
+		return a.pc != b.pc || a.a != b.a || a.x != b.x || a.y != b.y || a.sp != b.sp || a.status != b.status;
+	}
+
+	static bool CodeDiffers(const EmuThread::State& a, const EmuThread::State& b)
+	{
+		for (size_t i = 0; i < EmuThread::CODE_LINES; i++)
+		{
+			const EmuThread::CodeLine& l = a.code[i];
+			const EmuThread::CodeLine& r = b.code[i];
+			if (l.address != r.address || l.breakpoint != r.breakpoint || std::strcmp(l.text, r.text) != 0)
+				return true;
+		}
+		return false;
 	}
 
 	bool OnUserCreate()
@@ -209,53 +334,208 @@ public:
 
 		// Dont forget to set IRQ and NMI vectors if you want to play with those
 
-		// Extract dissassembly
-		mapAsm = cpu->disassemble(0x0000, 0xFFFF);
+		BuildTextTables();
 
 		// Reset
 		cpu->reset();
+		history.clear();
+
+		machine.setControllers(true);
+		machine.controllers.connect(&input);
+
+		// Draw Ram Page 0x00 and 0x80
+		emu.watchPage(0x00);
+		emu.watchPage(0x80);
+		emu.start();
+
+#if !defined(OLC_PGE_HEADLESS)
+		// 按 60Hz 出帧；画面没变的帧连呈现都跳过，暂停时几乎不占 CPU
+		SetFrameLimit(60.0f);
+		SetIdleSuspend(true);
+#endif
 		return true;
 	}
 
+	// 平台事件线程上调用
+	void OnKeyEvent(olc::Key key, bool bPressed) override
+	{
+		uint8_t mask = 0;
+		switch (key)
+		{
+		case olc::Key::A: mask = BUTTON_A; break;
+		case olc::Key::S: mask = BUTTON_B; break;
+		case olc::Key::TAB: mask = BUTTON_SELECT; break;
+		case olc::Key::ENTER: mask = BUTTON_START; break;
+		case olc::Key::UP: mask = BUTTON_UP; break;
+		case olc::Key::DOWN: mask = BUTTON_DOWN; break;
+		case olc::Key::LEFT: mask = BUTTON_LEFT; break;
+		case olc::Key::RIGHT: mask = BUTTON_RIGHT; break;
+		default: return;
+		}
+		if (bPressed)
+			input.press(0, mask);
+		else
+			input.release(0, mask);
+	}
+
 	bool OnUserUpdate(float fElapsedTime)
 	{
-		Clear(olc::DARK_BLUE);
+		struct KeyCommand { olc::Key key; EmuThread::Command command; };
+		static const KeyCommand keys[] = {
+			{ olc::Key::SPACE, EmuThread::Command::STEP },
+			{ olc::Key::Z, EmuThread::Command::REVERSE_STEP },
+			{ olc::Key::X, EmuThread::Command::REVERSE_CONTINUE },
+			{ olc::Key::B, EmuThread::Command::TOGGLE_BREAKPOINT },
+			{ olc::Key::C, EmuThread::Command::RUN_PAUSE },
+			{ olc::Key::R, EmuThread::Command::RESET },
+			{ olc::Key::I, EmuThread::Command::IRQ },
+			{ olc::Key::N, EmuThread::Command::NMI },
+			{ olc::Key::F, EmuThread::Command::THROTTLE },
+		};
+		for (const KeyCommand& k : keys)
+			if (GetKey(k.key).bPressed)
+				emu.post(k.command);
+
+		if (GetKey(olc::Key::V).bPressed)
+		{
+			if (dump)
+				dump.reset();
+			else
+			{
+				dump = std::make_unique<VideoDump>(ScreenWidth(), ScreenHeight(), VideoDump::Format::Y4M);
+				if (!dump->open("capture.y4m"))
+					dump.reset();
+			}
+		}
 
+		// 模拟线程最近一次发布的状态，画得慢也不会拖住模拟
+		const EmuThread::State& state = emu.latest();
 
-		if (GetKey(olc::Key::SPACE).bPressed)
+		const bool bAll = !bDrawnValid;
+		bool bChanged = bAll;
+		if (bAll)
 		{
-			do
+			Clear(olc::DARK_BLUE);
+			Text(10, 370, "SPACE = Step Instruction    R = RESET    I = IRQ    N = NMI    V = Record");
+			Text(10, 380, "B = Toggle Breakpoint at PC    C = Continue/Pause    L = Input Latency");
+		}
+
+		if (GetKey(olc::Key::L).bPressed)
+		{
+			bLatencyProbe = !bLatencyProbe;
+			nProbeStamp = state.inputStamp;
+			FillRect(10, 400, ScreenWidth() - 10, 8, olc::DARK_BLUE);
+			Text(10, 400, bLatencyProbe ? "Input latency: waiting for a pad read" : "");
+			bChanged = true;
+		}
+
+		// 内存页: 写入代数变了才逐行比较内容
+		const int nPageY[2] = { 2, 182 };
+		for (size_t i = 0; i < std::min<size_t>(state.pageCount, 2); i++)
+			if (bAll || state.pageGenerations[i] != drawn.pageGenerations[i])
+				bChanged |= DrawRam(2, nPageY[i], state, i, bAll);
+
+		if (bAll || RegistersDiffer(state, drawn))
+		{
+			FillRect(448, 2, ScreenWidth() - 448, 60, olc::DARK_BLUE);
+			DrawCpu(448, 2, state);
+			bChanged = true;
+		}
+
+		if (bAll || CodeDiffers(state, drawn))
+		{
+			FillRect(448, 72, ScreenWidth() - 448, int(EmuThread::CODE_LINES) * 10, olc::DARK_BLUE);
+			DrawCode(448, 72, state);
+			bChanged = true;
+		}
+
+		if (bAll || state.stopped != drawn.stopped || state.stopAddress != drawn.stopAddress)
+		{
+			FillRect(448, 350, ScreenWidth() - 448, 8, olc::DARK_BLUE);
+			if (state.stopped)
 			{
-				cpu->clock();
-			} while (!cpu->complete());
+				char line[16];
+				*PutHex16(PutStr(line, "BREAK at $"), state.stopAddress) = '\0';
+				Text(448, 350, line, olc::RED);
+			}
+			bChanged = true;
 		}
 
-		if (GetKey(olc::Key::R).bPressed)
-			cpu->reset();
+		if (bAll || state.throttled != drawn.throttled)
+		{
+			FillRect(10, 390, ScreenWidth() - 10, 8, olc::DARK_BLUE);
+			Text(10, 390, state.throttled ? "Z = Step Back    X = Reverse Continue    F = Full Speed"
+				: "Z = Step Back    X = Reverse Continue    F = 60Hz");
+			bChanged = true;
+		}
 
-		if (GetKey(olc::Key::I).bPressed)
-			cpu->irq();
+		// 这一帧马上就要呈现，按键事件到现在的时间就是输入到显示的延迟（不含显示器本身）
+		if (bLatencyProbe && state.inputStamp != 0 && state.inputStamp != nProbeStamp)
+		{
+			nProbeStamp = state.inputStamp;
+			char line[48];
+			char* p = PutStr(line, "Input latency: ");
+			const uint64_t nMicros = InputState::elapsed(state.inputStamp) / 1000;
+			p = PutDec(p, uint8_t(std::min<uint64_t>(nMicros / 1000, 255)));
+			*p++ = '.';
+			p = PutDec(p, uint8_t(nMicros % 1000 / 100));
+			*PutStr(p, " ms") = '\0';
+			FillRect(10, 400, ScreenWidth() - 10, 8, olc::DARK_BLUE);
+			Text(10, 400, line);
+			bChanged = true;
+		}
 
-		if (GetKey(olc::Key::N).bPressed)
-			cpu->nmi();
+		drawn = state;
+		bDrawnValid = true;
 
-		// Draw Ram Page 0x00		
-		DrawRam(2, 2, 0x0000, 16, 16);
-		DrawRam(2, 182, 0x8000, 16, 16);
-		DrawCpu(448, 2);
-		DrawCode(448, 72, 26);
+		// 画面没变就不再上传纹理，引擎据此跳过这一帧的呈现
+		EnablePixelTransfer(bChanged);
 
+		if (dump)
+			dump->submitRGBA(&GetDrawTarget()->GetData()->n);
 
-		DrawString(10, 370, "SPACE = Step Instruction    R = RESET    I = IRQ    N = NMI");
+		return nFrameLimit == 0 || ++nFramesDone < nFrameLimit;
+	}
 
+	bool OnUserDestroy()
+	{
+		emu.stop();
 		return true;
 	}
 };
 
+#if defined(OLC_PGE_HEADLESS)
+// 无显示环境: 软件渲染跑 nFrames 帧，报告耗时，并把最后一帧存成 PPM 供金样比对
+//   nes_headless [frames] [out.ppm]
+int main(int argc, char* argv[])
+{
+	Demo_OLC6502 demo;
+	demo.nFrameLimit = argc > 1 ? std::max<uint64_t>(1, std::strtoull(argv[1], nullptr, 0)) : 1;
+	if (demo.Construct(680, 480, 1, 1) != olc::OK)
+		return 1;
+
+	const auto tpStart = std::chrono::steady_clock::now();
+	demo.Start();
+	const double fSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - tpStart).count();
+
+	olc::Renderer_Headless* renderer = olc::Renderer_Headless::Current();
+	if (renderer == nullptr)
+		return 1;
+	std::printf("%llu frames in %.3f s (%.1f us/frame)\n", (unsigned long long)renderer->GetFrameCount(), fSeconds,
+		fSeconds * 1e6 / double(std::max<uint64_t>(1, renderer->GetFrameCount())));
+	if (argc > 2 && !renderer->SaveFrame(argv[2]))
+	{
+		std::fprintf(stderr, "can not write %s\n", argv[2]);
+		return 1;
+	}
+	return 0;
+}
+#else
 int main()
 {
 	Demo_OLC6502 demo;
 	demo.Construct(680, 480, 2, 2);
 	demo.Start();
 	return 0;
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
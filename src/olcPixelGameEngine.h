@@ -379,6 +379,7 @@ int main()
 // | STANDARD INCLUDES                                                            |
 // O------------------------------------------------------------------------------O
 #include <cmath>
+#include <cstdio>
 #include <cstdint>
 #include <string>
 #include <iostream>
@@ -995,6 +996,9 @@ public: // User Override Interfaces
 	virtual void OnTextEntryComplete(const std::string& sText);
 	// Called when a console command is executed
 	virtual bool OnConsoleCommand(const std::string& sCommand);
+	// Called from the platform's event handler the moment a key goes down or up, before
+	// the next OnUserUpdate() sees it. On some platforms this is not the engine thread
+	virtual void OnKeyEvent(olc::Key key, bool bPressed);
 
 
 public: // Hardware Interfaces
@@ -1171,6 +1175,23 @@ public: // DRAWING ROUTINES
 	// Dont allow PGE to mark layers as dirty, so pixel graphics don't update
 	void EnablePixelTransfer(const bool bEnable = true);
 
+	// Frame pacing on steady_clock: start frames fPerSecond apart, sleeping
+	// (then yielding for the last stretch) until each deadline; 0 runs flat out
+	void SetFrameLimit(float fPerSecond = 0.0f);
+	// While pixel transfer is disabled and nothing else is queued for the
+	// screen, skip presenting entirely; input is still polled and frames paced
+	void SetIdleSuspend(bool bEnable = true);
+
+	struct FrameStats
+	{
+		float fMeanFrameTime = 0.0f;	// seconds, over the last second
+		float fJitter = 0.0f;			// standard deviation of the frame time
+		uint32_t nFrames = 0;
+		uint32_t nSuspended = 0;		// frames that skipped presenting
+	};
+	// Achieved frame time and jitter, refreshed once a second
+	const FrameStats& GetFrameStats() const;
+
 	// Command Console Routines
 	void ConsoleShow(const olc::Key& keyExit, bool bSuspendTime = true);
 	bool IsConsoleShowing() const;
@@ -1254,7 +1275,16 @@ private: // Inner mysterious workings
 	DecalMode   nDecalMode = DecalMode::NORMAL;
 	DecalStructure nDecalStructure = DecalStructure::FAN;
 	std::function<olc::Pixel(const int x, const int y, const olc::Pixel&, const olc::Pixel&)> funcPixelMode;
-	std::chrono::time_point<std::chrono::system_clock> m_tp1, m_tp2;
+	std::chrono::time_point<std::chrono::steady_clock> m_tp1, m_tp2;
+	std::chrono::steady_clock::duration tFramePeriod{ 0 };
+	std::chrono::time_point<std::chrono::steady_clock> tpNextFrame;
+	bool		bIdleSuspend = false;
+	FrameStats	frameStats;
+	double		fStatSum = 0.0;
+	double		fStatSumSq = 0.0;
+	float		fStatTimer = 0.0f;
+	uint32_t	nStatFrames = 0;
+	uint32_t	nStatSuspended = 0;
 	std::vector<olc::vi2d> vFontSpacing;
 	std::vector<std::string> vDroppedFiles;
 	std::vector<std::string> vDroppedFilesCache;
@@ -1307,7 +1337,10 @@ public:
 	void olc_UpdateWindowSize(int32_t x, int32_t y);
 	void olc_UpdateViewport();
 	void olc_ConstructFontSheet();
+	void olc_BlitSprite(int32_t x, int32_t y, const Sprite* sprite, int32_t ox, int32_t oy, int32_t w, int32_t h, uint32_t scale, uint8_t flip);
 	void olc_CoreUpdate();
+	void olc_PaceFrame();
+	void olc_PresentFrame();
 	void olc_PrepareEngine();
 	void olc_UpdateMouseState(int32_t button, bool state);
 	void olc_UpdateKeyState(int32_t key, bool state);
@@ -2245,6 +2278,50 @@ bool PixelGameEngine::Draw(const olc::vi2d& pos, Pixel p)
 	return Draw(pos.x, pos.y, p);
 }
 
+// Row kernels for Clear, FillRect and DrawSprite. They give exactly the
+// result Draw() would for every pixel, but run over whole clipped rows
+// with no per-pixel mode switch or bounds check, so the compiler can
+// vectorise them. Custom pixel modes still go through Draw().
+namespace
+{
+	// a is (p.a / 255) * fBlendFactor, precomputed per alpha value by the row kernels
+	inline Pixel BlendPixelA(Pixel d, Pixel p, float a)
+	{
+		float c = 1.0f - a;
+		float r = a * (float)p.r + c * (float)d.r;
+		float g = a * (float)p.g + c * (float)d.g;
+		float b = a * (float)p.b + c * (float)d.b;
+		return Pixel((uint8_t)r, (uint8_t)g, (uint8_t)b/*, (uint8_t)(p.a * fBlendFactor)*/);
+	}
+
+	inline Pixel BlendPixel(Pixel d, Pixel p, float fBlendFactor)
+	{
+		return BlendPixelA(d, p, (float)(p.a / 255.0f) * fBlendFactor);
+	}
+
+	// Seed a few pixels, then keep doubling with memcpy; libc's memcpy is
+	// vectorised on every platform, whatever the optimisation level
+	inline void FillPixels(Pixel* dst, size_t n, Pixel p)
+	{
+		size_t k = std::min<size_t>(n, 16);
+		for (size_t i = 0; i < k; i++)
+			dst[i] = p;
+		while (k < n)
+		{
+			const size_t c = std::min(k, n - k);
+			std::memcpy(dst + k, dst, c * sizeof(Pixel));
+			k += c;
+		}
+	}
+
+	inline void BlendRow(Pixel* dst, int32_t n, Pixel p, float fBlendFactor)
+	{
+		const float a = (float)(p.a / 255.0f) * fBlendFactor;
+		for (int32_t i = 0; i < n; i++)
+			dst[i] = BlendPixelA(dst[i], p, a);
+	}
+}
+
 // This is it, the critical function that plots a pixel
 bool PixelGameEngine::Draw(int32_t x, int32_t y, Pixel p)
 {
@@ -2263,13 +2340,7 @@ bool PixelGameEngine::Draw(int32_t x, int32_t y, Pixel p)
 
 	if (nPixelMode == Pixel::ALPHA)
 	{
-		Pixel d = pDrawTarget->GetPixel(x, y);
-		float a = (float)(p.a / 255.0f) * fBlendFactor;
-		float c = 1.0f - a;
-		float r = a * (float)p.r + c * (float)d.r;
-		float g = a * (float)p.g + c * (float)d.g;
-		float b = a * (float)p.b + c * (float)d.b;
-		return pDrawTarget->SetPixel(x, y, Pixel((uint8_t)r, (uint8_t)g, (uint8_t)b/*, (uint8_t)(p.a * fBlendFactor)*/));
+		return pDrawTarget->SetPixel(x, y, BlendPixel(pDrawTarget->GetPixel(x, y), p, fBlendFactor));
 	}
 
 	if (nPixelMode == Pixel::CUSTOM)
@@ -2473,7 +2544,7 @@ void PixelGameEngine::Clear(Pixel p)
 {
 	int pixels = GetDrawTargetWidth() * GetDrawTargetHeight();
 	Pixel* m = GetDrawTarget()->GetData();
-	for (int i = 0; i < pixels; i++) m[i] = p;
+	FillPixels(m, pixels, p);
 }
 
 void PixelGameEngine::ClearBuffer(Pixel p, bool bDepth)
@@ -2524,6 +2595,25 @@ void PixelGameEngine::EnablePixelTransfer(const bool bEnable)
 	bSuspendTextureTransfer = !bEnable;
 }
 
+void PixelGameEngine::SetFrameLimit(float fPerSecond)
+{
+	if (fPerSecond > 0.0f)
+		tFramePeriod = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / fPerSecond));
+	else
+		tFramePeriod = std::chrono::steady_clock::duration::zero();
+	tpNextFrame = std::chrono::steady_clock::now();
+}
+
+void PixelGameEngine::SetIdleSuspend(bool bEnable)
+{
+	bIdleSuspend = bEnable;
+}
+
+const PixelGameEngine::FrameStats& PixelGameEngine::GetFrameStats() const
+{
+	return frameStats;
+}
+
 
 void PixelGameEngine::FillRect(const olc::vi2d& pos, const olc::vi2d& size, Pixel p)
 {
@@ -2545,6 +2635,29 @@ void PixelGameEngine::FillRect(int32_t x, int32_t y, int32_t w, int32_t h, Pixel
 	if (y2 < 0) y2 = 0;
 	if (y2 >= (int32_t)GetDrawTargetHeight()) y2 = (int32_t)GetDrawTargetHeight();
 
+	if (pDrawTarget == nullptr || x >= x2 || y >= y2)
+		return;
+
+	if (nPixelMode != Pixel::CUSTOM)
+	{
+		// MASK drops translucent colours entirely, same as Draw()
+		if (nPixelMode == Pixel::MASK && p.a != 255)
+			return;
+		const int32_t tw = pDrawTarget->width;
+		Pixel* first = pDrawTarget->GetData() + y * tw + x;
+		if (nPixelMode == Pixel::ALPHA)
+		{
+			for (int j = y; j < y2; j++)
+				BlendRow(first + (j - y) * tw, x2 - x, p, fBlendFactor);
+			return;
+		}
+		// One row, then copy it down
+		FillPixels(first, x2 - x, p);
+		for (int j = y + 1; j < y2; j++)
+			std::memcpy(first + (j - y) * tw, first, (x2 - x) * sizeof(Pixel));
+		return;
+	}
+
 	for (int i = x; i < x2; i++)
 		for (int j = y; j < y2; j++)
 			Draw(i, j, p);
@@ -2865,6 +2978,85 @@ void PixelGameEngine::FillTexturedPolygon(const std::vector<olc::vf2d>& vPoints,
 }
 
 
+// Fast path for DrawSprite and DrawPartialSprite in NORMAL, MASK and ALPHA
+// modes: clip the scaled destination once, then work a row at a time. In
+// NORMAL mode an unflipped 1:1 row is a memcpy, and with integer scaling
+// the remaining rows of each source row are copies of the first one.
+void PixelGameEngine::olc_BlitSprite(int32_t x, int32_t y, const Sprite* sprite, int32_t ox, int32_t oy, int32_t w, int32_t h, uint32_t scale, uint8_t flip)
+{
+	const int32_t s = (int32_t)scale;
+	const int32_t tw = pDrawTarget->width;
+	const int32_t th = pDrawTarget->height;
+	const int32_t dx0 = std::max(x, 0);
+	const int32_t dx1 = (int32_t)std::min<int64_t>((int64_t)x + (int64_t)w * s, tw);
+	const int32_t dy0 = std::max(y, 0);
+	const int32_t dy1 = (int32_t)std::min<int64_t>((int64_t)y + (int64_t)h * s, th);
+	if (dx0 >= dx1 || dy0 >= dy1)
+		return;
+
+	const bool bFlipX = (flip & olc::Sprite::Flip::HORIZ) != 0;
+	const bool bFlipY = (flip & olc::Sprite::Flip::VERT) != 0;
+	const int32_t n = dx1 - dx0;
+	const int32_t i0 = (dx0 - x) / s;
+	const int32_t nPhase = (dx0 - x) % s;
+	const int32_t nStep = bFlipX ? -1 : 1;
+	const Pixel::Mode mode = nPixelMode;
+	float fAlpha[256];
+	if (mode == Pixel::ALPHA)
+		for (int i = 0; i < 256; i++)
+			fAlpha[i] = (float)(i / 255.0f) * fBlendFactor;
+
+	auto row = [&](Pixel* d, const Pixel* src, auto op)
+	{
+		const Pixel* p = src + (bFlipX ? w - 1 - i0 : i0);
+		if (s == 1)
+		{
+			for (int32_t k = 0; k < n; k++, p += nStep)
+				op(d[k], *p);
+			return;
+		}
+		int32_t rep = nPhase;
+		for (int32_t k = 0; k < n; k++)
+		{
+			op(d[k], *p);
+			if (++rep == s) { rep = 0; p += nStep; }
+		}
+	};
+	auto copy = [](Pixel& d, Pixel p) { d = p; };
+	auto mask = [](Pixel& d, Pixel p) { if (p.a == 255) d = p; };
+	auto blend = [&fAlpha](Pixel& d, Pixel p) { d = BlendPixelA(d, p, fAlpha[p.a]); };
+
+	const Pixel* data = sprite->pColData.data();
+	Pixel* target = pDrawTarget->GetData();
+	for (int32_t dy = dy0; dy < dy1;)
+	{
+		const int32_t j = (dy - y) / s;
+		const int32_t band = std::min(s - (dy - y) % s, dy1 - dy);
+		const Pixel* src = data + (oy + (bFlipY ? h - 1 - j : j)) * sprite->width + ox;
+		Pixel* d = target + dy * tw + dx0;
+		if (mode == Pixel::NORMAL)
+		{
+			if (s == 1 && !bFlipX)
+				std::memcpy(d, src + i0, n * sizeof(Pixel));
+			else
+				row(d, src, copy);
+			for (int32_t r = 1; r < band; r++)
+				std::memcpy(d + r * tw, d, n * sizeof(Pixel));
+		}
+		else
+		{
+			for (int32_t r = 0; r < band; r++)
+			{
+				if (mode == Pixel::MASK)
+					row(d + r * tw, src, mask);
+				else
+					row(d + r * tw, src, blend);
+			}
+		}
+		dy += band;
+	}
+}
+
 void PixelGameEngine::DrawSprite(const olc::vi2d& pos, Sprite* sprite, uint32_t scale, uint8_t flip)
 {
 	DrawSprite(pos.x, pos.y, sprite, scale, flip);
@@ -2875,6 +3067,12 @@ void PixelGameEngine::DrawSprite(int32_t x, int32_t y, Sprite* sprite, uint32_t
 	if (sprite == nullptr)
 		return;
 
+	if (nPixelMode != Pixel::CUSTOM && pDrawTarget != nullptr && scale > 0)
+	{
+		olc_BlitSprite(x, y, sprite, 0, 0, sprite->width, sprite->height, scale, flip);
+		return;
+	}
+
 	int32_t fxs = 0, fxm = 1, fx = 0;
 	int32_t fys = 0, fym = 1, fy = 0;
 	if (flip & olc::Sprite::Flip::HORIZ) { fxs = sprite->width - 1; fxm = -1; }
@@ -2914,6 +3112,14 @@ void PixelGameEngine::DrawPartialSprite(int32_t x, int32_t y, Sprite* sprite, in
 	if (sprite == nullptr)
 		return;
 
+	// Source rectangles reaching outside the sprite depend on its sample mode, leave those to Draw()
+	if (nPixelMode != Pixel::CUSTOM && pDrawTarget != nullptr && scale > 0
+		&& ox >= 0 && oy >= 0 && w >= 0 && h >= 0 && ox + w <= sprite->width && oy + h <= sprite->height)
+	{
+		olc_BlitSprite(x, y, sprite, ox, oy, w, h, scale, flip);
+		return;
+	}
+
 	int32_t fxs = 0, fxm = 1, fx = 0;
 	int32_t fys = 0, fym = 1, fy = 0;
 	if (flip & olc::Sprite::Flip::HORIZ) { fxs = w - 1; fxm = -1; }
@@ -3849,6 +4055,7 @@ bool PixelGameEngine::OnUserDestroy()
 
 void PixelGameEngine::OnTextEntryComplete(const std::string& sText) { UNUSED(sText); }
 bool PixelGameEngine::OnConsoleCommand(const std::string& sCommand) { UNUSED(sCommand); return false; }
+void PixelGameEngine::OnKeyEvent(olc::Key key, bool bPressed) { UNUSED(key); UNUSED(bPressed); }
 
 // Externalised API
 void PixelGameEngine::olc_UpdateViewport()
@@ -3912,6 +4119,9 @@ void PixelGameEngine::olc_UpdateMouseState(int32_t button, bool state)
 
 void PixelGameEngine::olc_UpdateKeyState(int32_t key, bool state)
 {
+	// Key repeat delivers more presses; only report real transitions
+	if (pKeyNewState[key] != state && key != olc::Key::NONE)
+		OnKeyEvent(olc::Key(key), state);
 	pKeyNewState[key] = state;
 }
 
@@ -3969,8 +4179,8 @@ void PixelGameEngine::EngineThread()
 
 	while (bAtomActive)
 	{
-		// Run as fast as possible
-		while (bAtomActive) { olc_CoreUpdate(); }
+		// Run as fast as possible, or paced when a frame limit is set
+		while (bAtomActive) { olc_CoreUpdate(); olc_PaceFrame(); }
 
 		// Allow the user to free resources if they have overrided the destroy function
 		if (!OnUserDestroy())
@@ -3997,18 +4207,62 @@ void PixelGameEngine::olc_PrepareEngine()
 	vLayers[0].bShow = true;
 	SetDrawTarget(nullptr);
 
-	m_tp1 = std::chrono::system_clock::now();
-	m_tp2 = std::chrono::system_clock::now();
+	m_tp1 = std::chrono::steady_clock::now();
+	m_tp2 = std::chrono::steady_clock::now();
+	tpNextFrame = m_tp2;
+}
+
+void PixelGameEngine::olc_PaceFrame()
+{
+	if (tFramePeriod <= std::chrono::steady_clock::duration::zero())
+		return;
+
+	tpNextFrame += tFramePeriod;
+	const auto now = std::chrono::steady_clock::now();
+	// More than a frame behind: restart the schedule instead of rushing to catch up
+	if (now - tpNextFrame > tFramePeriod)
+	{
+		tpNextFrame = now;
+		return;
+	}
+	// Keep pumping platform events while waiting so key presses reach OnKeyEvent
+	// within a millisecond rather than at the next frame. Sleeps overshoot, so
+	// sleep to just short of the deadline and yield the rest
+	const auto slack = std::chrono::milliseconds(1);
+	for (auto t = now; tpNextFrame - t > slack; t = std::chrono::steady_clock::now())
+	{
+		platform->HandleSystemEvent();
+		std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(tpNextFrame - slack - t, slack));
+	}
+	while (std::chrono::steady_clock::now() < tpNextFrame)
+		std::this_thread::yield();
 }
 
 
 void PixelGameEngine::olc_CoreUpdate()
 {
 	// Handle Timing
-	m_tp2 = std::chrono::system_clock::now();
+	m_tp2 = std::chrono::steady_clock::now();
 	std::chrono::duration<float> elapsedTime = m_tp2 - m_tp1;
 	m_tp1 = m_tp2;
 
+	// Frame time statistics, published once a second
+	fStatSum += elapsedTime.count();
+	fStatSumSq += double(elapsedTime.count()) * elapsedTime.count();
+	fStatTimer += elapsedTime.count();
+	nStatFrames++;
+	if (fStatTimer >= 1.0f)
+	{
+		const double fMean = fStatSum / nStatFrames;
+		frameStats.fMeanFrameTime = float(fMean);
+		frameStats.fJitter = float(std::sqrt(std::max(0.0, fStatSumSq / nStatFrames - fMean * fMean)));
+		frameStats.nFrames = nStatFrames;
+		frameStats.nSuspended = nStatSuspended;
+		fStatSum = fStatSumSq = 0.0;
+		fStatTimer = 0.0f;
+		nStatFrames = nStatSuspended = 0;
+	}
+
 	// Our time per frame coefficient
 	float fElapsedTime = elapsedTime.count();
 	fLastElapsed = fElapsedTime;
@@ -4078,6 +4332,37 @@ void PixelGameEngine::olc_CoreUpdate()
 
 
 
+	// Nothing new to show: leave the last presented frame on screen
+	bool bIdle = bIdleSuspend && bSuspendTextureTransfer && !bConsoleShow;
+	for (auto& layer : vLayers)
+		if (!layer.vecDecalInstance.empty() || layer.funcHook != nullptr)
+			bIdle = false;
+	if (bIdle)
+		nStatSuspended++;
+	else
+		olc_PresentFrame();
+
+	// Update Title Bar
+	fFrameTimer += fElapsedTime;
+	nFrameCount++;
+	if (fFrameTimer >= 1.0f)
+	{
+		nLastFPS = nFrameCount;
+		fFrameTimer -= 1.0f;
+		std::string sTitle = "OneLoneCoder.com - Pixel Game Engine - " + sAppName + " - FPS: " + std::to_string(nFrameCount);
+		if (tFramePeriod > std::chrono::steady_clock::duration::zero())
+		{
+			char sPacing[64];
+			std::snprintf(sPacing, sizeof(sPacing), " (%.2fms +/- %.2fms)", frameStats.fMeanFrameTime * 1000.0f, frameStats.fJitter * 1000.0f);
+			sTitle += sPacing;
+		}
+		platform->SetWindowTitle(sTitle);
+		nFrameCount = 0;
+	}
+}
+
+void PixelGameEngine::olc_PresentFrame()
+{
 	// Display Frame
 	renderer->UpdateViewport(vViewPos, vViewSize);
 	renderer->ClearBuffer(olc::BLACK, true);
@@ -4120,18 +4405,6 @@ void PixelGameEngine::olc_CoreUpdate()
 
 	// Present Graphics to screen
 	renderer->DisplayFrame();
-
-	// Update Title Bar
-	fFrameTimer += fElapsedTime;
-	nFrameCount++;
-	if (fFrameTimer >= 1.0f)
-	{
-		nLastFPS = nFrameCount;
-		fFrameTimer -= 1.0f;
-		std::string sTitle = "OneLoneCoder.com - Pixel Game Engine - " + sAppName + " - FPS: " + std::to_string(nFrameCount);
-		platform->SetWindowTitle(sTitle);
-		nFrameCount = 0;
-	}
 }
 
 void PixelGameEngine::olc_ConstructFontSheet()
@@ -4241,24 +4514,304 @@ std::unique_ptr<ImageLoader> olc::Sprite::loader = nullptr;
 namespace olc
 {
 #if defined(OLC_GFX_HEADLESS)
+// Software renderer: composites layers and decals into an in-memory frame
+// the size of the viewport, so headless runs produce an image that can be
+// read back, saved and compared. Textures are sampled nearest-neighbour;
+// blending follows the OpenGL renderers' blend functions per decal mode.
 class Renderer_Headless : public olc::Renderer
 {
+public:
+	Renderer_Headless() { pCurrent = this; }
+	~Renderer_Headless() { if (pCurrent == this) pCurrent = nullptr; }
+
+	// The renderer the engine created, for reading frames back
+	static Renderer_Headless* Current() { return pCurrent; }
+
+	// Last composited frame, and how many have been presented
+	const olc::Sprite& GetFrame() const { return sprFrame; }
+	uint64_t GetFrameCount() const { return nFramesPresented; }
+
+	// Binary PPM, readable by every image tool without extra dependencies
+	bool SaveFrame(const std::string& sFile) const
+	{
+		std::FILE* f = std::fopen(sFile.c_str(), "wb");
+		if (f == nullptr) return false;
+		std::fprintf(f, "P6\n%d %d\n255\n", sprFrame.width, sprFrame.height);
+		std::vector<uint8_t> row(size_t(sprFrame.width) * 3);
+		for (int32_t y = 0; y < sprFrame.height; y++)
+		{
+			const olc::Pixel* src = sprFrame.pColData.data() + size_t(y) * sprFrame.width;
+			for (int32_t x = 0; x < sprFrame.width; x++)
+			{
+				row[x * 3 + 0] = src[x].r;
+				row[x * 3 + 1] = src[x].g;
+				row[x * 3 + 2] = src[x].b;
+			}
+			std::fwrite(row.data(), 1, row.size(), f);
+		}
+		return std::fclose(f) == 0;
+	}
+
 public:
 	virtual void       PrepareDevice() {};
 	virtual olc::rcode CreateDevice(std::vector<void*> params, bool bFullScreen, bool bVSYNC) { return olc::rcode::OK; }
 	virtual olc::rcode DestroyDevice() { return olc::rcode::OK; }
-	virtual void       DisplayFrame() {}
-	virtual void       PrepareDrawing() {}
-	virtual void	   SetDecalMode(const olc::DecalMode& mode) {}
-	virtual void       DrawLayerQuad(const olc::vf2d& offset, const olc::vf2d& scale, const olc::Pixel tint) {}
-	virtual void       DrawDecal(const olc::DecalInstance& decal) {}
-	virtual uint32_t   CreateTexture(const uint32_t width, const uint32_t height, const bool filtered = false, const bool clamp = true) { return 1; };
-	virtual void       UpdateTexture(uint32_t id, olc::Sprite* spr) {}
-	virtual void       ReadTexture(uint32_t id, olc::Sprite* spr) {}
-	virtual uint32_t   DeleteTexture(const uint32_t id) { return 1; }
-	virtual void       ApplyTexture(uint32_t id) {}
-	virtual void       UpdateViewport(const olc::vi2d& pos, const olc::vi2d& size) {}
-	virtual void       ClearBuffer(olc::Pixel p, bool bDepth) {}
+	virtual void       DisplayFrame() { nFramesPresented++; }
+	virtual void       PrepareDrawing() { nDecalMode = olc::DecalMode::NORMAL; }
+	virtual void	   SetDecalMode(const olc::DecalMode& mode) { nDecalMode = mode; }
+
+	virtual void DrawLayerQuad(const olc::vf2d& offset, const olc::vf2d& scale, const olc::Pixel tint)
+	{
+		const Texture* tex = Find(nBound);
+		if (tex == nullptr || tex->width == 0 || tex->height == 0 || sprFrame.width == 0 || sprFrame.height == 0) return;
+
+		// Texel row/column for every frame row/column, sampled at pixel centres
+		vMapX.resize(sprFrame.width);
+		vMapY.resize(sprFrame.height);
+		for (int32_t x = 0; x < sprFrame.width; x++)
+			vMapX[x] = Wrap(int32_t(std::floor((offset.x + scale.x * (x + 0.5f) / sprFrame.width) * tex->width)), tex->width, tex->clamp);
+		for (int32_t y = 0; y < sprFrame.height; y++)
+			vMapY[y] = Wrap(int32_t(std::floor((offset.y + scale.y * (y + 0.5f) / sprFrame.height) * tex->height)), tex->height, tex->clamp);
+
+		const bool bTint = tint != olc::WHITE;
+		for (int32_t y = 0; y < sprFrame.height; y++)
+		{
+			const olc::Pixel* src = tex->data.data() + size_t(vMapY[y]) * tex->width;
+			olc::Pixel* dst = sprFrame.pColData.data() + size_t(y) * sprFrame.width;
+			for (int32_t x = 0; x < sprFrame.width; x++)
+			{
+				const olc::Pixel p = bTint ? Modulate(src[vMapX[x]], tint) : src[vMapX[x]];
+				dst[x] = p.a == 255 ? p : Blend(olc::DecalMode::NORMAL, p, dst[x]);
+			}
+		}
+	}
+
+	virtual void DrawDecal(const olc::DecalInstance& decal)
+	{
+		SetDecalMode(decal.mode);
+		const Texture* tex = decal.decal != nullptr ? Find(decal.decal->id) : nullptr;
+		const uint32_t n = std::min<uint32_t>(decal.points, uint32_t(decal.pos.size()));
+		if (n == 0 || nDecalMode == olc::DecalMode::MODEL3D) return;
+
+		if (nDecalMode == olc::DecalMode::WIREFRAME || decal.structure == olc::DecalStructure::LINE)
+		{
+			const uint32_t nEdges = nDecalMode == olc::DecalMode::WIREFRAME ? n : n - 1;
+			for (uint32_t i = 0; i < nEdges; i++)
+				DrawEdge(decal, i, (i + 1) % n);
+			return;
+		}
+
+		if (decal.structure == olc::DecalStructure::FAN)
+			for (uint32_t i = 1; i + 1 < n; i++) DrawTriangle(decal, tex, 0, i, i + 1);
+		else if (decal.structure == olc::DecalStructure::STRIP)
+			for (uint32_t i = 0; i + 2 < n; i++) DrawTriangle(decal, tex, i, i + 1, i + 2);
+		else if (decal.structure == olc::DecalStructure::LIST)
+			for (uint32_t i = 0; i + 2 < n; i += 3) DrawTriangle(decal, tex, i, i + 1, i + 2);
+	}
+
+	virtual uint32_t CreateTexture(const uint32_t width, const uint32_t height, const bool filtered = false, const bool clamp = true)
+	{
+		UNUSED(filtered);
+		const uint32_t id = nNextTexture++;
+		Texture& tex = mapTextures[id];
+		tex.width = int32_t(width);
+		tex.height = int32_t(height);
+		tex.clamp = clamp;
+		tex.data.assign(size_t(width) * height, olc::BLANK);
+		return id;
+	}
+
+	virtual void UpdateTexture(uint32_t id, olc::Sprite* spr)
+	{
+		Texture& tex = mapTextures[id];
+		tex.width = spr->width;
+		tex.height = spr->height;
+		tex.data = spr->pColData;
+	}
+
+	virtual void ReadTexture(uint32_t id, olc::Sprite* spr)
+	{
+		const Texture* tex = Find(id);
+		if (tex != nullptr && tex->width == spr->width && tex->height == spr->height)
+			spr->pColData = tex->data;
+	}
+
+	virtual uint32_t DeleteTexture(const uint32_t id) { mapTextures.erase(id); return id; }
+	virtual void     ApplyTexture(uint32_t id) { nBound = id; }
+
+	virtual void UpdateViewport(const olc::vi2d& pos, const olc::vi2d& size)
+	{
+		UNUSED(pos);
+		if (size.x != sprFrame.width || size.y != sprFrame.height)
+		{
+			sprFrame.width = std::max(size.x, 0);
+			sprFrame.height = std::max(size.y, 0);
+			sprFrame.pColData.assign(size_t(sprFrame.width) * sprFrame.height, olc::BLACK);
+		}
+	}
+
+	virtual void ClearBuffer(olc::Pixel p, bool bDepth)
+	{
+		UNUSED(bDepth);
+		std::fill(sprFrame.pColData.begin(), sprFrame.pColData.end(), p);
+	}
+
+private:
+	struct Texture
+	{
+		int32_t width = 0;
+		int32_t height = 0;
+		bool clamp = true;
+		std::vector<olc::Pixel> data;
+	};
+
+	const Texture* Find(uint32_t id) const
+	{
+		auto it = mapTextures.find(id);
+		return it == mapTextures.end() ? nullptr : &it->second;
+	}
+
+	static int32_t Wrap(int32_t i, int32_t size, bool clamp)
+	{
+		if (clamp) return std::max(0, std::min(i, size - 1));
+		i %= size;
+		return i < 0 ? i + size : i;
+	}
+
+	static olc::Pixel Modulate(olc::Pixel a, olc::Pixel b)
+	{
+		return olc::Pixel(uint8_t((a.r * b.r + 127) / 255), uint8_t((a.g * b.g + 127) / 255),
+			uint8_t((a.b * b.b + 127) / 255), uint8_t((a.a * b.a + 127) / 255));
+	}
+
+	// dst = src * fs + dst * fd, with the factors the GL renderers use for each mode
+	static olc::Pixel Blend(olc::DecalMode mode, olc::Pixel s, olc::Pixel d)
+	{
+		auto mix = [&](int sc, int dc) -> uint8_t
+		{
+			int v = 0;
+			const int sa = s.a, ia = 255 - s.a;
+			switch (mode)
+			{
+			case olc::DecalMode::ADDITIVE:       v = (sc * sa + dc * 255 + 127) / 255; break;
+			case olc::DecalMode::MULTIPLICATIVE: v = (sc * dc + dc * ia + 127) / 255; break;
+			case olc::DecalMode::STENCIL:        v = (dc * sa + 127) / 255; break;
+			case olc::DecalMode::ILLUMINATE:     v = (sc * ia + dc * sa + 127) / 255; break;
+			default:                             v = (sc * sa + dc * ia + 127) / 255; break;
+			}
+			return uint8_t(std::min(v, 255));
+		};
+		return olc::Pixel(mix(s.r, d.r), mix(s.g, d.g), mix(s.b, d.b), mix(s.a, d.a));
+	}
+
+	olc::vf2d ToScreen(const olc::vf2d& p) const
+	{
+		return { (p.x + 1.0f) * 0.5f * sprFrame.width, (1.0f - p.y) * 0.5f * sprFrame.height };
+	}
+
+	void Plot(int32_t x, int32_t y, olc::Pixel p)
+	{
+		if (x < 0 || y < 0 || x >= sprFrame.width || y >= sprFrame.height) return;
+		olc::Pixel& d = sprFrame.pColData[size_t(y) * sprFrame.width + x];
+		d = Blend(nDecalMode, p, d);
+	}
+
+	void DrawEdge(const olc::DecalInstance& decal, uint32_t i0, uint32_t i1)
+	{
+		const olc::vf2d a = ToScreen(decal.pos[i0]), b = ToScreen(decal.pos[i1]);
+		const olc::Pixel col = i0 < decal.tint.size() ? decal.tint[i0] : olc::WHITE;
+		const int32_t steps = std::max(1, int32_t(std::ceil(std::max(std::abs(b.x - a.x), std::abs(b.y - a.y)))));
+		for (int32_t k = 0; k <= steps; k++)
+		{
+			const float t = float(k) / steps;
+			Plot(int32_t(std::floor(a.x + (b.x - a.x) * t)), int32_t(std::floor(a.y + (b.y - a.y) * t)), col);
+		}
+	}
+
+	// Edge-function rasteriser over pixel centres with a top-left fill rule.
+	// uv/w are interpolated affinely and divided per pixel, like the GL
+	// renderers' projective texture coordinates; tint is Gouraud shaded.
+	void DrawTriangle(const olc::DecalInstance& decal, const Texture* tex, uint32_t i0, uint32_t i1, uint32_t i2)
+	{
+		const uint32_t idx[3] = { i0, i1, i2 };
+		olc::vf2d v[3];
+		float u[3], t[3], w[3], c[3][4];
+		for (int k = 0; k < 3; k++)
+		{
+			const uint32_t i = idx[k];
+			v[k] = ToScreen(decal.pos[i]);
+			u[k] = i < decal.uv.size() ? decal.uv[i].x : 0.0f;
+			t[k] = i < decal.uv.size() ? decal.uv[i].y : 0.0f;
+			w[k] = i < decal.w.size() ? decal.w[i] : 1.0f;
+			const olc::Pixel p = i < decal.tint.size() ? decal.tint[i] : olc::WHITE;
+			c[k][0] = p.r; c[k][1] = p.g; c[k][2] = p.b; c[k][3] = p.a;
+		}
+
+		float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+		if (area == 0.0f) return;
+		if (area < 0.0f)
+		{
+			std::swap(v[1], v[2]); std::swap(u[1], u[2]); std::swap(t[1], t[2]); std::swap(w[1], w[2]);
+			for (int k = 0; k < 4; k++) std::swap(c[1][k], c[2][k]);
+			area = -area;
+		}
+
+		const int32_t x0 = std::max(0, int32_t(std::floor(std::min({ v[0].x, v[1].x, v[2].x }))));
+		const int32_t x1 = std::min(sprFrame.width - 1, int32_t(std::ceil(std::max({ v[0].x, v[1].x, v[2].x }))));
+		const int32_t y0 = std::max(0, int32_t(std::floor(std::min({ v[0].y, v[1].y, v[2].y }))));
+		const int32_t y1 = std::min(sprFrame.height - 1, int32_t(std::ceil(std::max({ v[0].y, v[1].y, v[2].y }))));
+
+		// Edge k is opposite vertex k; in this (y down, positive area) winding a
+		// top edge runs left-to-right horizontally and a left edge runs upwards
+		auto owns = [&](int k, float e)
+		{
+			if (e != 0.0f) return e > 0.0f;
+			const olc::vf2d& a = v[(k + 1) % 3];
+			const olc::vf2d& b = v[(k + 2) % 3];
+			return (a.y == b.y && b.x < a.x) || b.y < a.y;
+		};
+
+		for (int32_t y = y0; y <= y1; y++)
+		{
+			const float py = y + 0.5f;
+			for (int32_t x = x0; x <= x1; x++)
+			{
+				const float px = x + 0.5f;
+				float e[3];
+				for (int k = 0; k < 3; k++)
+				{
+					const olc::vf2d& a = v[(k + 1) % 3];
+					const olc::vf2d& b = v[(k + 2) % 3];
+					e[k] = (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+				}
+				if (!owns(0, e[0]) || !owns(1, e[1]) || !owns(2, e[2])) continue;
+
+				const float b0 = e[0] / area, b1 = e[1] / area, b2 = e[2] / area;
+				olc::Pixel texel = olc::WHITE;
+				if (tex != nullptr && tex->width > 0 && tex->height > 0)
+				{
+					const float q = b0 * w[0] + b1 * w[1] + b2 * w[2];
+					const float su = (b0 * u[0] + b1 * u[1] + b2 * u[2]) / q;
+					const float sv = (b0 * t[0] + b1 * t[1] + b2 * t[2]) / q;
+					const int32_t tx = Wrap(int32_t(std::floor(su * tex->width)), tex->width, tex->clamp);
+					const int32_t ty = Wrap(int32_t(std::floor(sv * tex->height)), tex->height, tex->clamp);
+					texel = tex->data[size_t(ty) * tex->width + tx];
+				}
+				auto lerp = [&](int ch) { return uint8_t(std::lround(std::clamp(b0 * c[0][ch] + b1 * c[1][ch] + b2 * c[2][ch], 0.0f, 255.0f))); };
+				Plot(x, y, Modulate(texel, olc::Pixel(lerp(0), lerp(1), lerp(2), lerp(3))));
+			}
+		}
+	}
+
+	static inline Renderer_Headless* pCurrent = nullptr;
+
+	olc::Sprite sprFrame;
+	std::map<uint32_t, Texture> mapTextures;
+	uint32_t nNextTexture = 1;
+	uint32_t nBound = 0;
+	olc::DecalMode nDecalMode = olc::DecalMode::NORMAL;
+	uint64_t nFramesPresented = 0;
+	std::vector<int32_t> vMapX, vMapY;
 };
 #endif
 #if defined(OLC_PLATFORM_HEADLESS)
@@ -0,0 +1,52 @@
+﻿#include "ppu.h"
+
+#include "video_dump.h"
+#include "video_pipeline.h"
+
+namespace nes {
+void renderScreen(const uint8_t* screen, uint8_t mask, uint32_t* out)
+{
+    // 灰度模式只保留调色板索引的高两位（亮度）
+    const uint8_t index = (mask & PPU_MASK_GREYSCALE) ? 0x30 : 0x3F;
+    for (size_t i = 0; i < 32 * 32; i++) {
+        out[i] = PALETTE_2C02[screen[i] & index];
+    }
+}
+
+void PpuRegisters::attach(Bus& bus)
+{
+    for (size_t page = 0x20; page < 0x40; page++) {
+        bus.attachDevice(static_cast<uint8_t>(page), this);
+    }
+}
+
+void PpuRegisters::detach(Bus& bus)
+{
+    for (size_t page = 0x20; page < 0x40; page++) {
+        bus.attachDevice(static_cast<uint8_t>(page), nullptr);
+    }
+}
+
+uint8_t PpuRegisters::ioRead(uint16_t address, uint8_t data)
+{
+    if ((address & 0x07) != 0x02) {
+        return data;
+    }
+    // 低 5 位是总线上残留的值，读过之后 vblank 清零
+    const uint8_t status = static_cast<uint8_t>((state.status & 0xE0) | (data & 0x1F));
+    setVblank(false);
+    return status;
+}
+
+void PpuRegisters::ioWrite(uint16_t address, uint8_t data)
+{
+    switch (address & 0x07) {
+    case 0x00: state.ctrl = data; break;
+    case 0x01: state.mask = data; break;
+    default: return;
+    }
+    if (pipeline != nullptr) {
+        pipeline->record(static_cast<uint16_t>(0x2000 | (address & 0x07)), data);
+    }
+}
+}
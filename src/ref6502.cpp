@@ -0,0 +1,401 @@
+﻿#include "ref6502.h"
+
+namespace nes {
+namespace {
+constexpr uint8_t FC = 0x01;
+constexpr uint8_t FZ = 0x02;
+constexpr uint8_t FI = 0x04;
+constexpr uint8_t FD = 0x08;
+constexpr uint8_t FB = 0x10;
+constexpr uint8_t FU = 0x20;
+constexpr uint8_t FV = 0x40;
+constexpr uint8_t FN = 0x80;
+}
+
+void Ref6502::write(uint16_t address, uint8_t data)
+{
+    mem[address] = data;
+    writes.push_back({ address, data });
+}
+
+uint16_t Ref6502::word(uint16_t address) const
+{
+    return static_cast<uint16_t>(read(address) | (read(static_cast<uint16_t>(address + 1)) << 8));
+}
+
+void Ref6502::push(uint8_t data)
+{
+    write(0x0100 | sp, data);
+    sp--;
+}
+
+uint8_t Ref6502::pull()
+{
+    sp++;
+    return read(0x0100 | sp);
+}
+
+void Ref6502::setFlag(uint8_t f, bool v)
+{
+    status = v ? (status | f) : (status & ~f);
+}
+
+void Ref6502::setZN(uint8_t v)
+{
+    setFlag(FZ, v == 0);
+    setFlag(FN, v & 0x80);
+}
+
+uint16_t Ref6502::imm()
+{
+    return pc++;
+}
+
+uint16_t Ref6502::zp()
+{
+    return read(pc++);
+}
+
+uint16_t Ref6502::zpx()
+{
+    return (read(pc++) + x) & 0xFF;
+}
+
+uint16_t Ref6502::zpy()
+{
+    return (read(pc++) + y) & 0xFF;
+}
+
+uint16_t Ref6502::abs()
+{
+    const uint16_t address = word(pc);
+    pc += 2;
+    return address;
+}
+
+uint16_t Ref6502::abx(bool& crossed)
+{
+    const uint16_t base = abs();
+    const uint16_t address = base + x;
+    crossed = (base & 0xFF00) != (address & 0xFF00);
+    return address;
+}
+
+uint16_t Ref6502::aby(bool& crossed)
+{
+    const uint16_t base = abs();
+    const uint16_t address = base + y;
+    crossed = (base & 0xFF00) != (address & 0xFF00);
+    return address;
+}
+
+uint16_t Ref6502::izx()
+{
+    const uint8_t ptr = read(pc++) + x;
+    return static_cast<uint16_t>(read(ptr) | (read(static_cast<uint8_t>(ptr + 1)) << 8));
+}
+
+uint16_t Ref6502::izy(bool& crossed)
+{
+    const uint8_t ptr = read(pc++);
+    const uint16_t base = static_cast<uint16_t>(read(ptr) | (read(static_cast<uint8_t>(ptr + 1)) << 8));
+    const uint16_t address = base + y;
+    crossed = (base & 0xFF00) != (address & 0xFF00);
+    return address;
+}
+
+int Ref6502::branch(bool taken)
+{
+    const int8_t offset = static_cast<int8_t>(read(pc++));
+    if (!taken) {
+        return 2;
+    }
+    const uint16_t target = static_cast<uint16_t>(pc + offset);
+    const int cycles = (target & 0xFF00) != (pc & 0xFF00) ? 4 : 3;
+    pc = target;
+    return cycles;
+}
+
+void Ref6502::adc(uint8_t v)
+{
+    const uint16_t sum = a + v + (flag(FC) ? 1 : 0);
+    setFlag(FC, sum > 0xFF);
+    setFlag(FV, (~(a ^ v) & (a ^ sum)) & 0x80);
+    a = static_cast<uint8_t>(sum);
+    setZN(a);
+}
+
+void Ref6502::compare(uint8_t reg, uint8_t v)
+{
+    setFlag(FC, reg >= v);
+    setZN(static_cast<uint8_t>(reg - v));
+}
+
+uint8_t Ref6502::asl(uint8_t v)
+{
+    setFlag(FC, v & 0x80);
+    v <<= 1;
+    setZN(v);
+    return v;
+}
+
+uint8_t Ref6502::lsr(uint8_t v)
+{
+    setFlag(FC, v & 0x01);
+    v >>= 1;
+    setZN(v);
+    return v;
+}
+
+uint8_t Ref6502::rol(uint8_t v)
+{
+    const bool carry = flag(FC);
+    setFlag(FC, v & 0x80);
+    v = static_cast<uint8_t>((v << 1) | (carry ? 1 : 0));
+    setZN(v);
+    return v;
+}
+
+uint8_t Ref6502::ror(uint8_t v)
+{
+    const bool carry = flag(FC);
+    setFlag(FC, v & 0x01);
+    v = static_cast<uint8_t>((v >> 1) | (carry ? 0x80 : 0));
+    setZN(v);
+    return v;
+}
+
+int Ref6502::step()
+{
+    writes.clear();
+    const uint16_t start = pc;
+    const uint8_t op = read(pc++);
+    bool c = false;
+    uint16_t ad = 0;
+
+    // 读-改-写指令的公共写法
+    auto rmw = [&](uint16_t address, uint8_t (Ref6502::*fn)(uint8_t))
+    {
+        write(address, (this->*fn)(read(address)));
+    };
+    auto inc = [&](uint16_t address, int delta)
+    {
+        const uint8_t v = static_cast<uint8_t>(read(address) + delta);
+        write(address, v);
+        setZN(v);
+    };
+
+    switch (op) {
+    // 加载
+    case 0xA9: a = read(imm()); setZN(a); return 2;
+    case 0xA5: a = read(zp()); setZN(a); return 3;
+    case 0xB5: a = read(zpx()); setZN(a); return 4;
+    case 0xAD: a = read(abs()); setZN(a); return 4;
+    case 0xBD: a = read(abx(c)); setZN(a); return 4 + c;
+    case 0xB9: a = read(aby(c)); setZN(a); return 4 + c;
+    case 0xA1: a = read(izx()); setZN(a); return 6;
+    case 0xB1: a = read(izy(c)); setZN(a); return 5 + c;
+    case 0xA2: x = read(imm()); setZN(x); return 2;
+    case 0xA6: x = read(zp()); setZN(x); return 3;
+    case 0xB6: x = read(zpy()); setZN(x); return 4;
+    case 0xAE: x = read(abs()); setZN(x); return 4;
+    case 0xBE: x = read(aby(c)); setZN(x); return 4 + c;
+    case 0xA0: y = read(imm()); setZN(y); return 2;
+    case 0xA4: y = read(zp()); setZN(y); return 3;
+    case 0xB4: y = read(zpx()); setZN(y); return 4;
+    case 0xAC: y = read(abs()); setZN(y); return 4;
+    case 0xBC: y = read(abx(c)); setZN(y); return 4 + c;
+
+    // 存储
+    case 0x85: write(zp(), a); return 3;
+    case 0x95: write(zpx(), a); return 4;
+    case 0x8D: write(abs(), a); return 4;
+    case 0x9D: write(abx(c), a); return 5;
+    case 0x99: write(aby(c), a); return 5;
+    case 0x81: write(izx(), a); return 6;
+    case 0x91: write(izy(c), a); return 6;
+    case 0x86: write(zp(), x); return 3;
+    case 0x96: write(zpy(), x); return 4;
+    case 0x8E: write(abs(), x); return 4;
+    case 0x84: write(zp(), y); return 3;
+    case 0x94: write(zpx(), y); return 4;
+    case 0x8C: write(abs(), y); return 4;
+
+    // 寄存器传送
+    case 0xAA: x = a; setZN(x); return 2;
+    case 0xA8: y = a; setZN(y); return 2;
+    case 0xBA: x = sp; setZN(x); return 2;
+    case 0x8A: a = x; setZN(a); return 2;
+    case 0x9A: sp = x; return 2;
+    case 0x98: a = y; setZN(a); return 2;
+
+    // 栈
+    case 0x48: push(a); return 3;
+    case 0x08: push(status | FB | FU); return 3;
+    case 0x68: a = pull(); setZN(a); return 4;
+    case 0x28: status = (pull() & ~FB) | FU; return 4;
+
+    // 逻辑运算
+    case 0x29: a &= read(imm()); setZN(a); return 2;
+    case 0x25: a &= read(zp()); setZN(a); return 3;
+    case 0x35: a &= read(zpx()); setZN(a); return 4;
+    case 0x2D: a &= read(abs()); setZN(a); return 4;
+    case 0x3D: a &= read(abx(c)); setZN(a); return 4 + c;
+    case 0x39: a &= read(aby(c)); setZN(a); return 4 + c;
+    case 0x21: a &= read(izx()); setZN(a); return 6;
+    case 0x31: a &= read(izy(c)); setZN(a); return 5 + c;
+    case 0x49: a ^= read(imm()); setZN(a); return 2;
+    case 0x45: a ^= read(zp()); setZN(a); return 3;
+    case 0x55: a ^= read(zpx()); setZN(a); return 4;
+    case 0x4D: a ^= read(abs()); setZN(a); return 4;
+    case 0x5D: a ^= read(abx(c)); setZN(a); return 4 + c;
+    case 0x59: a ^= read(aby(c)); setZN(a); return 4 + c;
+    case 0x41: a ^= read(izx()); setZN(a); return 6;
+    case 0x51: a ^= read(izy(c)); setZN(a); return 5 + c;
+    case 0x09: a |= read(imm()); setZN(a); return 2;
+    case 0x05: a |= read(zp()); setZN(a); return 3;
+    case 0x15: a |= read(zpx()); setZN(a); return 4;
+    case 0x0D: a |= read(abs()); setZN(a); return 4;
+    case 0x1D: a |= read(abx(c)); setZN(a); return 4 + c;
+    case 0x19: a |= read(aby(c)); setZN(a); return 4 + c;
+    case 0x01: a |= read(izx()); setZN(a); return 6;
+    case 0x11: a |= read(izy(c)); setZN(a); return 5 + c;
+    case 0x24:
+    case 0x2C: {
+        const uint8_t v = read(op == 0x24 ? zp() : abs());
+        setFlag(FZ, (a & v) == 0);
+        setFlag(FV, v & 0x40);
+        setFlag(FN, v & 0x80);
+        return op == 0x24 ? 3 : 4;
+    }
+
+    // 算术运算
+    case 0x69: adc(read(imm())); return 2;
+    case 0x65: adc(read(zp())); return 3;
+    case 0x75: adc(read(zpx())); return 4;
+    case 0x6D: adc(read(abs())); return 4;
+    case 0x7D: adc(read(abx(c))); return 4 + c;
+    case 0x79: adc(read(aby(c))); return 4 + c;
+    case 0x61: adc(read(izx())); return 6;
+    case 0x71: adc(read(izy(c))); return 5 + c;
+    case 0xE9: adc(~read(imm())); return 2;
+    case 0xE5: adc(~read(zp())); return 3;
+    case 0xF5: adc(~read(zpx())); return 4;
+    case 0xED: adc(~read(abs())); return 4;
+    case 0xFD: adc(~read(abx(c))); return 4 + c;
+    case 0xF9: adc(~read(aby(c))); return 4 + c;
+    case 0xE1: adc(~read(izx())); return 6;
+    case 0xF1: adc(~read(izy(c))); return 5 + c;
+    case 0xC9: compare(a, read(imm())); return 2;
+    case 0xC5: compare(a, read(zp())); return 3;
+    case 0xD5: compare(a, read(zpx())); return 4;
+    case 0xCD: compare(a, read(abs())); return 4;
+    case 0xDD: compare(a, read(abx(c))); return 4 + c;
+    case 0xD9: compare(a, read(aby(c))); return 4 + c;
+    case 0xC1: compare(a, read(izx())); return 6;
+    case 0xD1: compare(a, read(izy(c))); return 5 + c;
+    case 0xE0: compare(x, read(imm())); return 2;
+    case 0xE4: compare(x, read(zp())); return 3;
+    case 0xEC: compare(x, read(abs())); return 4;
+    case 0xC0: compare(y, read(imm())); return 2;
+    case 0xC4: compare(y, read(zp())); return 3;
+    case 0xCC: compare(y, read(abs())); return 4;
+
+    // 加一/减一
+    case 0xE6: inc(zp(), 1); return 5;
+    case 0xF6: inc(zpx(), 1); return 6;
+    case 0xEE: inc(abs(), 1); return 6;
+    case 0xFE: inc(abx(c), 1); return 7;
+    case 0xC6: inc(zp(), -1); return 5;
+    case 0xD6: inc(zpx(), -1); return 6;
+    case 0xCE: inc(abs(), -1); return 6;
+    case 0xDE: inc(abx(c), -1); return 7;
+    case 0xE8: x++; setZN(x); return 2;
+    case 0xC8: y++; setZN(y); return 2;
+    case 0xCA: x--; setZN(x); return 2;
+    case 0x88: y--; setZN(y); return 2;
+
+    // 移位
+    case 0x0A: a = asl(a); return 2;
+    case 0x06: rmw(zp(), &Ref6502::asl); return 5;
+    case 0x16: rmw(zpx(), &Ref6502::asl); return 6;
+    case 0x0E: rmw(abs(), &Ref6502::asl); return 6;
+    case 0x1E: rmw(abx(c), &Ref6502::asl); return 7;
+    case 0x4A: a = lsr(a); return 2;
+    case 0x46: rmw(zp(), &Ref6502::lsr); return 5;
+    case 0x56: rmw(zpx(), &Ref6502::lsr); return 6;
+    case 0x4E: rmw(abs(), &Ref6502::lsr); return 6;
+    case 0x5E: rmw(abx(c), &Ref6502::lsr); return 7;
+    case 0x2A: a = rol(a); return 2;
+    case 0x26: rmw(zp(), &Ref6502::rol); return 5;
+    case 0x36: rmw(zpx(), &Ref6502::rol); return 6;
+    case 0x2E: rmw(abs(), &Ref6502::rol); return 6;
+    case 0x3E: rmw(abx(c), &Ref6502::rol); return 7;
+    case 0x6A: a = ror(a); return 2;
+    case 0x66: rmw(zp(), &Ref6502::ror); return 5;
+    case 0x76: rmw(zpx(), &Ref6502::ror); return 6;
+    case 0x6E: rmw(abs(), &Ref6502::ror); return 6;
+    case 0x7E: rmw(abx(c), &Ref6502::ror); return 7;
+
+    // 跳转
+    case 0x4C: pc = abs(); return 3;
+    case 0x6C: {
+        // 间接跳转的页内回绕 bug
+        const uint16_t ptr = abs();
+        const uint16_t hiAddr = (ptr & 0xFF00) | ((ptr + 1) & 0x00FF);
+        pc = static_cast<uint16_t>(read(ptr) | (read(hiAddr) << 8));
+        return 5;
+    }
+    case 0x20:
+        ad = abs();
+        pc--;
+        push(pc >> 8);
+        push(pc & 0xFF);
+        pc = ad;
+        return 6;
+    case 0x60:
+        pc = pull();
+        pc |= pull() << 8;
+        pc++;
+        return 6;
+    case 0x40:
+        status = (pull() & ~FB) | FU;
+        pc = pull();
+        pc |= pull() << 8;
+        return 6;
+    case 0x00:
+        pc++;
+        push(pc >> 8);
+        push(pc & 0xFF);
+        push(status | FB | FU);
+        setFlag(FI, true);
+        pc = word(0xFFFE);
+        return 7;
+
+    // 分支
+    case 0x10: return branch(!flag(FN));
+    case 0x30: return branch(flag(FN));
+    case 0x50: return branch(!flag(FV));
+    case 0x70: return branch(flag(FV));
+    case 0x90: return branch(!flag(FC));
+    case 0xB0: return branch(flag(FC));
+    case 0xD0: return branch(!flag(FZ));
+    case 0xF0: return branch(flag(FZ));
+
+    // 标志位
+    case 0x18: setFlag(FC, false); return 2;
+    case 0x38: setFlag(FC, true); return 2;
+    case 0x58: setFlag(FI, false); return 2;
+    case 0x78: setFlag(FI, true); return 2;
+    case 0xB8: setFlag(FV, false); return 2;
+    case 0xD8: setFlag(FD, false); return 2;
+    case 0xF8: setFlag(FD, true); return 2;
+
+    case 0xEA: return 2;
+
+    default:
+        pc = start;
+        return 0;
+    }
+}
+}
@@ -0,0 +1,187 @@
+﻿#include "rom_disasm.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+
+#include "flow_graph.h"
+#include "machine.h"
+#include "parallel.h"
+
+namespace nes {
+namespace {
+bool readFile(const std::string& path, std::vector<uint8_t>& data)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+void setText(RomDisassembly::Line& line, const std::string& text)
+{
+    const size_t n = std::min(text.size(), sizeof(line.text) - 1);
+    std::memcpy(line.text, text.data(), n);
+    line.text[n] = '\0';
+}
+}
+
+RomDisassembly::~RomDisassembly()
+{
+    cancel();
+    wait();
+}
+
+bool RomDisassembly::open(const std::string& romPath, const std::string& cdlPath, std::string& error)
+{
+    cancel();
+    wait();
+
+    std::vector<uint8_t> data;
+    if (!readFile(romPath, data)) {
+        error = "can not open file";
+        return false;
+    }
+    if (data.size() < 16 || std::memcmp(data.data(), "NES\x1A", 4) != 0) {
+        error = "not an iNES file";
+        return false;
+    }
+    const size_t prgSize = static_cast<size_t>(data[4]) * BANK_SIZE;
+    const size_t offset = 16 + ((data[6] & 0x04) ? 512 : 0);
+    if (prgSize == 0 || data.size() < offset + prgSize) {
+        error = "truncated PRG ROM";
+        return false;
+    }
+    prg.assign(data.begin() + offset, data.begin() + offset + prgSize);
+
+    cdl.clear();
+    if (!cdlPath.empty()) {
+        if (!readFile(cdlPath, cdl) || cdl.size() < prg.size()) {
+            error = "bad CDL file";
+            return false;
+        }
+        cdl.resize(prg.size());
+    }
+
+    banks = prg.size() / BANK_SIZE;
+    lines = std::make_unique<Line[]>(prg.size());
+    ready = std::make_unique<std::atomic<uint8_t>[]>(banks);
+    for (size_t i = 0; i < banks; i++) {
+        ready[i].store(0, std::memory_order_relaxed);
+    }
+    done = 0;
+    cancelled = false;
+    return true;
+}
+
+// 最后一个 bank 固定在 $C000（NROM 和大多数 16K 切换的 mapper 都是这样），其余的切到 $8000
+uint16_t RomDisassembly::bankBase(size_t bank) const
+{
+    return bank + 1 == banks ? 0xC000 : 0x8000;
+}
+
+void RomDisassembly::start(unsigned threads)
+{
+    if (job.joinable() || banks == 0) {
+        return;
+    }
+    job = std::thread([this, threads]
+    {
+        // 固定 bank 先做，界面一打开就能看到复位入口附近的代码
+        std::vector<size_t> order;
+        order.push_back(banks - 1);
+        for (size_t i = 0; i + 1 < banks; i++) {
+            order.push_back(i);
+        }
+        parallelFor(order.size(), [&](size_t i)
+        {
+            if (!cancelled.load(std::memory_order_relaxed)) {
+                disassembleBank(order[i]);
+            }
+        }, threads);
+    });
+}
+
+void RomDisassembly::cancel()
+{
+    cancelled = true;
+}
+
+void RomDisassembly::wait()
+{
+    if (job.joinable()) {
+        job.join();
+    }
+}
+
+void RomDisassembly::disassembleBank(size_t bank)
+{
+    const uint16_t base = bankBase(bank);
+    const uint8_t* src = prg.data() + bank * BANK_SIZE;
+
+    // 每个任务一台自己的机器: 这个 bank 映射到它的窗口，固定 bank 映射到 $C000 以便跟踪跨 bank 调用
+    auto m = std::make_unique<Machine>();
+    m->load(0xC000, prg.data() + (banks - 1) * BANK_SIZE, BANK_SIZE);
+    m->load(base, src, BANK_SIZE);
+
+    ControlFlowGraph cfg(m->cpu);
+    cfg.setUseCdl(false);
+    bool haveEntries = base == 0xC000;
+    if (!cdl.empty()) {
+        // FCEUX 的代码位也覆盖操作数，只把连续代码段的开头当作入口
+        const uint8_t* flags = cdl.data() + bank * BANK_SIZE;
+        for (size_t i = 0; i < BANK_SIZE; i++) {
+            if ((flags[i] & 0x01) && (i == 0 || !(flags[i - 1] & 0x01))) {
+                cfg.addEntry(static_cast<uint16_t>(base + i));
+                haveEntries = true;
+            }
+        }
+    }
+
+    // 没有任何入口时（没有 CDL 的切换 bank）只能线性反汇编
+    std::map<uint16_t, std::string> text;
+    if (haveEntries) {
+        cfg.analyze(*m->bus);
+        text = cfg.disassemble(m->cpu);
+    }
+    else {
+        text = m->cpu.disassemble(base, static_cast<uint16_t>(BANK_SIZE - 1));
+    }
+
+    Line* out = lines.get() + bank * BANK_SIZE;
+    size_t covered = 0;
+    for (size_t i = 0; i < BANK_SIZE; i++) {
+        Line& line = out[i];
+        line.offset = static_cast<uint32_t>(bank * BANK_SIZE + i);
+        line.address = static_cast<uint16_t>(base + i);
+        const auto it = text.find(line.address);
+        if (it != text.end() && (haveEntries ? cfg.isInstruction(line.address) : true) && i >= covered) {
+            line.length = static_cast<uint8_t>(std::min<size_t>(m->cpu.getInstructionLength(src[i]), BANK_SIZE - i));
+            line.code = 1;
+            setText(line, it->second);
+            covered = i + line.length;
+        }
+        else if (i >= covered) {
+            char buf[32];
+            std::snprintf(buf, sizeof(buf), "$%04X: .DB $%02X", line.address, src[i]);
+            line.length = 1;
+            line.code = 0;
+            setText(line, buf);
+            covered = i + 1;
+        }
+        else {
+            line.length = 0;
+            line.code = 1;
+            line.text[0] = '\0';
+        }
+    }
+
+    ready[bank].store(1, std::memory_order_release);
+    done.fetch_add(1, std::memory_order_acq_rel);
+}
+}
@@ -0,0 +1,68 @@
+﻿#include "run_ahead.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace nes {
+namespace {
+using Clock = std::chrono::steady_clock;
+
+double micros(Clock::time_point from, Clock::time_point to)
+{
+    return std::chrono::duration<double, std::micro>(to - from).count();
+}
+}
+
+RunAhead::RunAhead(Machine& machine, uint32_t frames)
+    : machine(machine), ahead(std::min(frames, MAX_FRAMES))
+{
+}
+
+void RunAhead::setFrames(uint32_t frames)
+{
+    ahead = std::min(frames, MAX_FRAMES);
+}
+
+void RunAhead::runFrame()
+{
+    const RenderMode mode = machine.renderMode();
+    const Clock::time_point t0 = Clock::now();
+    Clock::time_point t1 = t0;
+    Clock::time_point t2 = t0;
+    Clock::time_point t3 = t0;
+
+    if (ahead == 0) {
+        machine.runFrames(1);
+        t3 = Clock::now();
+    }
+    else {
+        // 真实的一帧不出画面，预测的帧里也只有最后一帧出画面
+        machine.setRenderMode(RenderMode::RAM_ONLY);
+        machine.runFrames(1);
+        t1 = Clock::now();
+        machine.saveCheckpoint(*checkpoint);
+        t2 = Clock::now();
+        if (ahead > 1) {
+            machine.runFrames(ahead - 1);
+        }
+        machine.setRenderMode(mode);
+        machine.runFrames(1);
+        t3 = Clock::now();
+        machine.loadCheckpoint(*checkpoint);
+    }
+    const Clock::time_point t4 = Clock::now();
+
+    sum.save += micros(t1, t2);
+    sum.restore += micros(t3, t4);
+    sum.emulate += micros(t0, t1) + micros(t2, t3);
+    sum.total += micros(t0, t4);
+    if (++sum.frames == WINDOW) {
+        published.save = sum.save / WINDOW;
+        published.restore = sum.restore / WINDOW;
+        published.emulate = sum.emulate / WINDOW;
+        published.total = sum.total / WINDOW;
+        published.frames = WINDOW;
+        sum = Metrics{};
+    }
+}
+}
@@ -0,0 +1,255 @@
+﻿#include "time_travel.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+namespace nes {
+namespace {
+// 间隔的上下限，避免速度估计异常时退化
+constexpr uint64_t MIN_INTERVAL = 1000;
+constexpr uint64_t MAX_INTERVAL = 50'000'000;
+}
+
+TimeTravel::TimeTravel(Machine& machine, Debugger& debugger, double stepBudget, size_t maxSnapshots)
+    : machine(machine), debugger(debugger), step_budget(stepBudget), max_snapshots(std::max<size_t>(maxSnapshots, 4))
+{
+    takeSnapshot();
+}
+
+void TimeTravel::clear()
+{
+    for (auto& p : snapshots) {
+        spare.push_back(std::move(p.state));
+    }
+    snapshots.clear();
+    events.clear();
+    event_cursor = 0;
+    takeSnapshot();
+}
+
+void TimeTravel::takeSnapshot()
+{
+    std::unique_ptr<Machine::Snapshot> state;
+    if (!spare.empty()) {
+        state = std::move(spare.back());
+        spare.pop_back();
+    }
+    else {
+        state = std::make_unique<Machine::Snapshot>();
+    }
+    machine.saveSnapshot(*state);
+    snapshots.push_back({ now(), std::move(state) });
+    if (snapshots.size() > max_snapshots) {
+        thin();
+    }
+}
+
+void TimeTravel::maybeSnapshot()
+{
+    if (now() - snapshots.back().cycle >= interval) {
+        takeSnapshot();
+    }
+}
+
+// 最新的一半保持原来的密度，较旧的一半隔一个删一个（起点永远保留）
+void TimeTravel::thin()
+{
+    const size_t old = snapshots.size() / 2;
+    std::vector<Point> kept;
+    kept.reserve(snapshots.size());
+    for (size_t i = 0; i < snapshots.size(); i++) {
+        if (i < old && (i & 1)) {
+            spare.push_back(std::move(snapshots[i].state));
+        }
+        else {
+            kept.push_back(std::move(snapshots[i]));
+        }
+    }
+    snapshots = std::move(kept);
+}
+
+size_t TimeTravel::latestBefore(uint64_t cycle) const
+{
+    const auto it = std::lower_bound(snapshots.begin(), snapshots.end(), cycle,
+        [](const Point& p, uint64_t c) { return p.cycle < c; });
+    return it == snapshots.begin() ? 0 : static_cast<size_t>(it - snapshots.begin()) - 1;
+}
+
+void TimeTravel::restore(size_t index)
+{
+    machine.loadSnapshot(*snapshots[index].state);
+    // 快照总是在同一周期的事件之前保存的
+    const uint64_t c = snapshots[index].cycle;
+    event_cursor = static_cast<size_t>(std::lower_bound(events.begin(), events.end(), c,
+        [](const Record& r, uint64_t v) { return r.cycle < v; }) - events.begin());
+}
+
+void TimeTravel::truncateAfter(uint64_t cycle)
+{
+    while (snapshots.size() > 1 && snapshots.back().cycle > cycle) {
+        spare.push_back(std::move(snapshots.back().state));
+        snapshots.pop_back();
+    }
+}
+
+void TimeTravel::apply(Event event)
+{
+    switch (event) {
+    case Event::RESET: machine.reset(); break;
+    case Event::IRQ: machine.cpu.irq(); break;
+    case Event::NMI: machine.cpu.nmi(); break;
+    }
+}
+
+void TimeTravel::applyEvents()
+{
+    while (event_cursor < events.size() && events[event_cursor].cycle <= now()) {
+        apply(events[event_cursor++].event);
+    }
+}
+
+uint64_t TimeTravel::nextEventCycle() const
+{
+    return event_cursor < events.size() ? events[event_cursor].cycle : std::numeric_limits<uint64_t>::max();
+}
+
+// 新的外部事件让之后的历史作废
+void TimeTravel::inject(Event event)
+{
+    events.resize(event_cursor);
+    truncateAfter(now());
+    events.push_back({ now(), event });
+    event_cursor = events.size();
+    apply(event);
+}
+
+void TimeTravel::reset() { inject(Event::RESET); }
+void TimeTravel::irq() { inject(Event::IRQ); }
+void TimeTravel::nmi() { inject(Event::NMI); }
+
+void TimeTravel::stepOnce()
+{
+    applyEvents();
+    machine.step();
+    maybeSnapshot();
+}
+
+void TimeTravel::forwardTo(uint64_t target)
+{
+    while (now() < target) {
+        stepOnce();
+    }
+}
+
+Debugger::Stop TimeTravel::runUntil(uint64_t limit)
+{
+    while (now() < limit) {
+        applyEvents();
+        const uint64_t due = std::max(snapshots.back().cycle + interval, now() + 1);
+        const uint64_t chunk = std::min({ limit, due, nextEventCycle() }) - now();
+        const Debugger::Stop stop = debugger.run(chunk);
+        maybeSnapshot();
+        if (stop != Debugger::Stop::NONE) {
+            return stop;
+        }
+    }
+    return Debugger::Stop::NONE;
+}
+
+// 带事件重放地运行到 limit 或者命中为止，不记录快照
+Debugger::Stop TimeTravel::replay(uint64_t limit)
+{
+    while (now() < limit) {
+        applyEvents();
+        const uint64_t chunk = std::min(limit, nextEventCycle()) - now();
+        const Debugger::Stop stop = debugger.run(chunk);
+        if (stop != Debugger::Stop::NONE) {
+            return stop;
+        }
+    }
+    return Debugger::Stop::NONE;
+}
+
+Debugger::Stop TimeTravel::step()
+{
+    applyEvents();
+    const Debugger::Stop stop = debugger.step();
+    maybeSnapshot();
+    return stop;
+}
+
+Debugger::Stop TimeTravel::run(uint64_t cycles)
+{
+    const auto t0 = std::chrono::steady_clock::now();
+    const uint64_t start = now();
+    const Debugger::Stop stop = runUntil(start + cycles);
+
+    // 一次反向单步最多重放约两个间隔（先找上一条指令的边界，再从附近的快照走过去）
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    const uint64_t ran = now() - start;
+    if (seconds > 0.001 && ran > 0) {
+        const double target = ran / seconds * step_budget / 3.0;
+        interval = std::clamp(static_cast<uint64_t>(target), MIN_INTERVAL, MAX_INTERVAL);
+    }
+    return stop;
+}
+
+bool TimeTravel::reverseStep()
+{
+    const uint64_t cur = now();
+    if (snapshots.front().cycle >= cur) {
+        return false;
+    }
+
+    // 第一遍: 从当前位置之前最近的快照走到现在，找出上一条指令开始时的周期；
+    // 同时按间隔补上快照，之后连续反向单步就不用再从很远的快照重放
+    truncateAfter(cur - 1);
+    restore(latestBefore(cur));
+    uint64_t previous = now();
+    while (now() < cur) {
+        previous = now();
+        stepOnce();
+    }
+
+    // 第二遍: 从不晚于目标的最近快照走到目标
+    truncateAfter(previous);
+    restore(snapshots.size() - 1);
+    forwardTo(previous);
+    return true;
+}
+
+Debugger::Stop TimeTravel::reverseContinue()
+{
+    // 从后往前逐段搜索: 段 k 覆盖 (snapshots[k].cycle, limit)，找其中最后一次命中
+    uint64_t limit = now();
+    for (size_t k = latestBefore(limit) + 1; k-- > 0;) {
+        const uint64_t begin = snapshots[k].cycle;
+        restore(k);
+        uint64_t hit = 0;
+        size_t hits = 0;
+        while (now() < limit) {
+            if (replay(limit) != Debugger::Stop::NONE && now() < limit) {
+                hit = now();
+                hits++;
+            }
+        }
+
+        if (hits > 0) {
+            // 再从段首依次走过每次命中，停在最后一次上，lastHit() 也就对应这次命中
+            restore(k);
+            for (size_t n = 0; n < hits; n++) {
+                replay(hit);
+            }
+            truncateAfter(now());
+            return debugger.lastHit().reason;
+        }
+        // 下一段的上限是本段段首，正好停在段首的命中归前一段
+        limit = begin + 1;
+    }
+
+    truncateAfter(snapshots.front().cycle);
+    restore(0);
+    return Debugger::Stop::NONE;
+}
+}
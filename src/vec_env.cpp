@@ -0,0 +1,126 @@
+﻿#include "vec_env.h"
+
+#include <spdlog/spdlog.h>
+
+namespace nes {
+VecEnv::VecEnv(const VecEnvConfig& config, size_t count, unsigned threads)
+    : config(config), pool(threads)
+{
+    observeAddresses = config.observeAddresses;
+    if (observeAddresses.empty()) {
+        for (uint16_t a = 0x0000; a < 0x0800; a++) {
+            observeAddresses.push_back(a);
+        }
+    }
+
+    // 只启动一次，存下起始状态，各实例都从这里恢复
+    Machine boot;
+    boot.setRenderMode(RenderMode::RAM_ONLY);
+    boot.setControllers(config.controllerInput);
+    if (!boot.loadFile(config.program, config.loadAddress, error)) {
+        spdlog::error("VecEnv: {}: {}", config.program, error);
+        return;
+    }
+    boot.reset();
+    boot.runFrames(config.warmupFrames);
+    start = std::make_unique<Machine::Snapshot>();
+    boot.saveSnapshot(*start);
+
+    envs.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        envs.push_back(std::make_unique<Env>());
+        envs.back()->m.setRenderMode(RenderMode::RAM_ONLY);
+        envs.back()->m.setControllers(config.controllerInput);
+        resetEnv(*envs.back());
+    }
+}
+
+void VecEnv::resetEnv(Env& env)
+{
+    env.m.loadSnapshot(*start);
+    env.m.controllers.setButtons(0, 0x00);
+    env.lastReward.resize(config.rewards.size());
+    for (size_t r = 0; r < config.rewards.size(); r++) {
+        env.lastReward[r] = readValue(env, config.rewards[r]);
+    }
+}
+
+int64_t VecEnv::readValue(const Env& env, const RewardSpec& spec) const
+{
+    const auto& ram = env.m.bus->ram;
+    int64_t v = 0;
+    for (int i = spec.bytes - 1; i >= 0; i--) {
+        const uint8_t b = ram[static_cast<uint16_t>(spec.address + i)];
+        v = spec.bcd ? v * 100 + (b >> 4) * 10 + (b & 0x0F) : (v << 8) | b;
+    }
+    return v;
+}
+
+float VecEnv::collectReward(Env& env) const
+{
+    float reward = 0.0f;
+    for (size_t r = 0; r < config.rewards.size(); r++) {
+        const int64_t v = readValue(env, config.rewards[r]);
+        reward += config.rewards[r].scale * static_cast<float>(v - env.lastReward[r]);
+        env.lastReward[r] = v;
+    }
+    return reward;
+}
+
+void VecEnv::observe(const Env& env, uint8_t* out) const
+{
+    const auto& ram = env.m.bus->ram;
+    for (size_t i = 0; i < observeAddresses.size(); i++) {
+        out[i] = ram[observeAddresses[i]];
+    }
+}
+
+void VecEnv::reset(uint8_t* observations)
+{
+    if (!start) {
+        return;
+    }
+    pool.parallelFor(envs.size(), [&](size_t i)
+    {
+        resetEnv(*envs[i]);
+        observe(*envs[i], observations + i * observationSize());
+    });
+}
+
+void VecEnv::step(const uint8_t* actions, uint8_t* observations, float* rewards, uint8_t* dones)
+{
+    if (!start) {
+        return;
+    }
+    pool.parallelFor(envs.size(), [&](size_t i)
+    {
+        Env& env = *envs[i];
+        float reward = 0.0f;
+        bool done = false;
+        for (uint32_t f = 0; f < config.frameskip && !done; f++) {
+            const uint8_t action = f < config.actionRepeat ? actions[i] : 0x00;
+            if (config.controllerInput) {
+                env.m.controllers.setButtons(0, action);
+            }
+            else {
+                // 走总线写，页代数和挂在这一页上的设备都能看到，增量检查点不会漏掉它
+                env.m.bus->write(config.inputAddress, action);
+            }
+            env.m.runFrames(1);
+            reward += collectReward(env);
+            done = config.useDone && env.m.bus->ram[config.doneAddress] == config.doneValue;
+        }
+
+        if (done) {
+            resetEnv(env);
+        }
+        if (rewards != nullptr) {
+            rewards[i] = reward;
+        }
+        if (dones != nullptr) {
+            dones[i] = done ? 1 : 0;
+        }
+        observe(env, observations + i * observationSize());
+    });
+}
+}
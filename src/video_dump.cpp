@@ -0,0 +1,208 @@
+﻿#include "video_dump.h"
+
+#include <cstring>
+#include <spdlog/spdlog.h>
+
+namespace nes {
+namespace {
+constexpr uint32_t rgb(uint32_t r, uint32_t g, uint32_t b)
+{
+    return 0xFF000000U | (b << 16) | (g << 8) | r;
+}
+}
+
+const std::array<uint32_t, 64> PALETTE_2C02 = {
+    rgb(84, 84, 84),    rgb(0, 30, 116),    rgb(8, 16, 144),    rgb(48, 0, 136),
+    rgb(68, 0, 100),    rgb(92, 0, 48),     rgb(84, 4, 0),      rgb(60, 24, 0),
+    rgb(32, 42, 0),     rgb(8, 58, 0),      rgb(0, 64, 0),      rgb(0, 60, 0),
+    rgb(0, 50, 60),     rgb(0, 0, 0),       rgb(0, 0, 0),       rgb(0, 0, 0),
+    rgb(152, 150, 152), rgb(8, 76, 196),    rgb(48, 50, 236),   rgb(92, 30, 228),
+    rgb(136, 20, 176),  rgb(160, 20, 100),  rgb(152, 34, 32),   rgb(120, 60, 0),
+    rgb(84, 90, 0),     rgb(40, 114, 0),    rgb(8, 124, 0),     rgb(0, 118, 40),
+    rgb(0, 102, 120),   rgb(0, 0, 0),       rgb(0, 0, 0),       rgb(0, 0, 0),
+    rgb(236, 238, 236), rgb(76, 154, 236),  rgb(120, 124, 236), rgb(176, 98, 236),
+    rgb(228, 84, 236),  rgb(236, 88, 180),  rgb(236, 106, 100), rgb(212, 136, 32),
+    rgb(160, 170, 0),   rgb(116, 196, 0),   rgb(76, 208, 32),   rgb(56, 204, 108),
+    rgb(56, 180, 204),  rgb(60, 60, 60),    rgb(0, 0, 0),       rgb(0, 0, 0),
+    rgb(236, 238, 236), rgb(168, 204, 236), rgb(188, 188, 236), rgb(212, 178, 236),
+    rgb(236, 174, 236), rgb(236, 174, 212), rgb(236, 180, 176), rgb(228, 196, 144),
+    rgb(204, 210, 120), rgb(180, 222, 120), rgb(168, 226, 144), rgb(152, 226, 180),
+    rgb(160, 214, 228), rgb(160, 162, 160), rgb(0, 0, 0),       rgb(0, 0, 0),
+};
+
+VideoDump::VideoDump(uint32_t width, uint32_t height, Format format, uint32_t queueDepth, uint32_t fps)
+    : width(width), height(height), format(format), fps(fps)
+{
+    // 槽位在这里一次性分配好，提交帧时只有 memcpy
+    slots.resize(queueDepth > 0 ? queueDepth : 1);
+    for (auto& slot : slots) {
+        slot.data.resize(static_cast<size_t>(width) * height * 4);
+    }
+}
+
+VideoDump::~VideoDump()
+{
+    close();
+}
+
+bool VideoDump::open(const std::string& path)
+{
+    close();
+
+    if (path == "-") {
+        out = stdout;
+    }
+    else {
+        out = std::fopen(path.c_str(), "wb");
+    }
+    if (out == nullptr) {
+        spdlog::error("VideoDump: can not open {}", path);
+        return false;
+    }
+
+    if (format == Format::Y4M) {
+        std::fprintf(out, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C444\n", width, height, fps);
+    }
+
+    head.store(0);
+    tail.store(0);
+    written.store(0);
+    dropped.store(0);
+    stopping.store(false);
+    writer = std::thread(&VideoDump::writerLoop, this);
+    return true;
+}
+
+void VideoDump::close()
+{
+    if (writer.joinable()) {
+        // 写线程会先把队列里剩余的帧写完再退出
+        stopping.store(true, std::memory_order_release);
+        signal.fetch_add(1, std::memory_order_release);
+        signal.notify_one();
+        writer.join();
+    }
+
+    if (out != nullptr) {
+        std::fflush(out);
+        if (out != stdout) {
+            std::fclose(out);
+        }
+        out = nullptr;
+        spdlog::info("VideoDump: {} frames written, {} dropped", framesWritten(), framesDropped());
+    }
+}
+
+VideoDump::Slot* VideoDump::acquire()
+{
+    if (out == nullptr) {
+        return nullptr;
+    }
+
+    const uint64_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) >= slots.size()) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    return &slots[t % slots.size()];
+}
+
+void VideoDump::publish()
+{
+    tail.fetch_add(1, std::memory_order_release);
+    signal.fetch_add(1, std::memory_order_release);
+    signal.notify_one();
+}
+
+bool VideoDump::submitRGBA(const uint32_t* pixels)
+{
+    Slot* slot = acquire();
+    if (slot == nullptr) {
+        return false;
+    }
+
+    slot->kind = Kind::RGBA;
+    std::memcpy(slot->data.data(), pixels, static_cast<size_t>(width) * height * 4);
+    publish();
+    return true;
+}
+
+bool VideoDump::submitIndexed(const uint8_t* indices)
+{
+    Slot* slot = acquire();
+    if (slot == nullptr) {
+        return false;
+    }
+
+    // 只拷贝调色板下标，查表放到写线程
+    slot->kind = Kind::INDEXED;
+    slot->palette = palette;
+    std::memcpy(slot->data.data(), indices, static_cast<size_t>(width) * height);
+    publish();
+    return true;
+}
+
+void VideoDump::writerLoop()
+{
+    while (true) {
+        const uint32_t seen = signal.load(std::memory_order_acquire);
+        const uint64_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            if (stopping.load(std::memory_order_acquire)) {
+                break;
+            }
+            signal.wait(seen, std::memory_order_acquire);
+            continue;
+        }
+
+        writeFrame(slots[h % slots.size()]);
+        head.store(h + 1, std::memory_order_release);
+        written.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void VideoDump::writeFrame(const Slot& slot)
+{
+    const size_t pixels = static_cast<size_t>(width) * height;
+    auto pixel = [&](size_t i) -> uint32_t
+    {
+        if (slot.kind == Kind::INDEXED) {
+            return slot.palette[slot.data[i] & 0x3F];
+        }
+        uint32_t p;
+        std::memcpy(&p, &slot.data[i * 4], 4);
+        return p;
+    };
+
+    if (format == Format::RAW_RGB) {
+        line.resize(static_cast<size_t>(width) * 3);
+        for (size_t row = 0; row < height; row++) {
+            for (size_t col = 0; col < width; col++) {
+                const uint32_t p = pixel(row * width + col);
+                line[col * 3 + 0] = p & 0xFF;
+                line[col * 3 + 1] = (p >> 8) & 0xFF;
+                line[col * 3 + 2] = (p >> 16) & 0xFF;
+            }
+            std::fwrite(line.data(), 1, line.size(), out);
+        }
+        return;
+    }
+
+    // Y4M: BT.601 limited range, 三个平面依次写出
+    line.resize(pixels * 3);
+    uint8_t* py = line.data();
+    uint8_t* pu = py + pixels;
+    uint8_t* pv = pu + pixels;
+    for (size_t i = 0; i < pixels; i++) {
+        const uint32_t p = pixel(i);
+        const int r = p & 0xFF;
+        const int g = (p >> 8) & 0xFF;
+        const int b = (p >> 16) & 0xFF;
+        py[i] = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        pu[i] = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+        pv[i] = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+    }
+    std::fputs("FRAME\n", out);
+    std::fwrite(line.data(), 1, line.size(), out);
+}
+}
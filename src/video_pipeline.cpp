@@ -0,0 +1,121 @@
+﻿#include "video_pipeline.h"
+
+#include "machine.h"
+#include "ppu.h"
+
+namespace nes {
+VideoPipeline::VideoPipeline(const OLC6502& cpu)
+    : cpu(cpu)
+{
+    worker = std::thread(&VideoPipeline::renderLoop, this);
+}
+
+VideoPipeline::~VideoPipeline()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    worker.join();
+}
+
+void VideoPipeline::attach(Bus& bus)
+{
+    for (size_t page = SCREEN_ADDRESS >> 8; page < (SCREEN_ADDRESS + sizeof(screen)) >> 8; page++) {
+        bus.attachDevice(static_cast<uint8_t>(page), this);
+    }
+}
+
+void VideoPipeline::detach(Bus& bus)
+{
+    for (size_t page = SCREEN_ADDRESS >> 8; page < (SCREEN_ADDRESS + sizeof(screen)) >> 8; page++) {
+        bus.attachDevice(static_cast<uint8_t>(page), nullptr);
+    }
+}
+
+void VideoPipeline::record(uint16_t address, uint8_t data)
+{
+    current.writes.push_back({ static_cast<uint32_t>(cpu.getCycleCount() - frame_start), address, data });
+}
+
+void VideoPipeline::resync(const uint8_t* ram, uint8_t ppuMask)
+{
+    // 之前记的写入属于被替换掉的状态，直接丢掉
+    frame_start = cpu.getCycleCount();
+    current.writes.clear();
+    for (size_t i = 0; i < screen.size(); i++) {
+        current.writes.push_back({ 0, static_cast<uint16_t>(SCREEN_ADDRESS + i), ram[SCREEN_ADDRESS + i] });
+    }
+    current.writes.push_back({ 0, 0x2001, ppuMask });
+}
+
+void VideoPipeline::endFrame(FrameSink* sink)
+{
+    frame_start = cpu.getCycleCount();
+    if (current.writes.empty() && sink == nullptr) {
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        // 渲染线程落后太多时等它，日志不能丢
+        drained.wait(guard, [this] { return queue.size() < QUEUE_FRAMES; });
+        current.sink = sink;
+        queue.push_back(std::move(current));
+        current = Frame{};
+        if (!spare.empty()) {
+            current.writes = std::move(spare.back());
+            spare.pop_back();
+        }
+    }
+    wake.notify_one();
+}
+
+void VideoPipeline::flush()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    drained.wait(guard, [this] { return queue.empty() && !rendering; });
+}
+
+void VideoPipeline::renderLoop()
+{
+    for (;;) {
+        Frame frame;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+            frame = std::move(queue.front());
+            queue.pop_front();
+            rendering = true;
+        }
+
+        for (const Write& w : frame.writes) {
+            if (w.address >= 0x2000) {
+                // 目前只有 $2001 影响画面
+                if (w.address == 0x2001) {
+                    mask = w.data;
+                }
+            }
+            else {
+                screen[w.address - SCREEN_ADDRESS] = w.data;
+            }
+        }
+        if (frame.sink != nullptr) {
+            renderScreen(screen.data(), mask, framebuffer.data());
+            frame.sink->onFrame(framebuffer.data(), SCREEN_WIDTH, SCREEN_HEIGHT);
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            frame.writes.clear();
+            spare.push_back(std::move(frame.writes));
+            rendering = false;
+        }
+        drained.notify_all();
+    }
+}
+}
@@ -0,0 +1,318 @@
+﻿#include "write_trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+#include <spdlog/spdlog.h>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace nes {
+
+// 只追加的临时文件，读取时整体映射到内存，文件变长后下次读取再重新映射
+class WriteTrace::SpillFile {
+public:
+    explicit SpillFile(const std::string& path) : path(path) {
+#if defined(_WIN32)
+        handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+            FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+        ok = handle != INVALID_HANDLE_VALUE;
+#else
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        ok = fd >= 0;
+#endif
+    }
+
+    ~SpillFile() {
+        unmap();
+#if defined(_WIN32)
+        if (ok) {
+            CloseHandle(handle);
+        }
+#else
+        if (ok) {
+            ::close(fd);
+            ::unlink(path.c_str());
+        }
+#endif
+    }
+
+    bool isOpen() const { return ok; }
+
+    // 追加写入，返回数据在文件里的偏移，失败返回 false
+    bool append(const void* data, size_t len, uint64_t& offset) {
+        offset = size;
+        const char* p = static_cast<const char*>(data);
+        while (len > 0) {
+#if defined(_WIN32)
+            LARGE_INTEGER pos;
+            pos.QuadPart = static_cast<LONGLONG>(size);
+            OVERLAPPED ov{};
+            ov.Offset = pos.LowPart;
+            ov.OffsetHigh = static_cast<DWORD>(pos.HighPart);
+            DWORD written = 0;
+            const DWORD n = static_cast<DWORD>(std::min<size_t>(len, 1u << 30));
+            if (!WriteFile(handle, p, n, &written, &ov) || written == 0) {
+                return false;
+            }
+#else
+            const ssize_t written = ::pwrite(fd, p, len, static_cast<off_t>(size));
+            if (written <= 0) {
+                return false;
+            }
+#endif
+            p += written;
+            len -= static_cast<size_t>(written);
+            size += static_cast<uint64_t>(written);
+        }
+        return true;
+    }
+
+    const uint8_t* data() const {
+        if (mapped_size != size) {
+            unmap();
+            map();
+        }
+        return base;
+    }
+
+private:
+    void map() const {
+        if (size == 0) {
+            return;
+        }
+#if defined(_WIN32)
+        mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) {
+            spdlog::error("WriteTrace: CreateFileMapping failed for {}", path);
+            return;
+        }
+        base = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+        void* p = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        base = p == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(p);
+#endif
+        if (base == nullptr) {
+            spdlog::error("WriteTrace: can not map {}", path);
+            return;
+        }
+        mapped_size = size;
+    }
+
+    void unmap() const {
+        if (base != nullptr) {
+#if defined(_WIN32)
+            UnmapViewOfFile(base);
+#else
+            ::munmap(const_cast<uint8_t*>(base), mapped_size);
+#endif
+        }
+#if defined(_WIN32)
+        if (mapping != nullptr) {
+            CloseHandle(mapping);
+            mapping = nullptr;
+        }
+#endif
+        base = nullptr;
+        mapped_size = 0;
+    }
+
+    std::string path;
+    bool ok = false;
+    uint64_t size = 0;
+#if defined(_WIN32)
+    HANDLE handle = INVALID_HANDLE_VALUE;
+    mutable HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+    mutable const uint8_t* base = nullptr;
+    mutable uint64_t mapped_size = 0;
+};
+
+WriteTrace::WriteTrace(Machine& machine, size_t memoryChunks, const std::string& spillPath)
+    : machine(machine), memory_chunks(std::max<size_t>(memoryChunks, 1)), spill_path(spillPath)
+{
+    if (spill_path.empty()) {
+        const auto name = "nes_trace_" + std::to_string(reinterpret_cast<uintptr_t>(this)) + ".bin";
+        std::error_code ec;
+        spill_path = (std::filesystem::temp_directory_path(ec) / name).string();
+    }
+}
+
+WriteTrace::~WriteTrace()
+{
+    stop();
+}
+
+void WriteTrace::start()
+{
+    machine.bus->tracer = this;
+    if (machine.restoreCount() != restore_seen) {
+        // 停止记录期间恢复过状态
+        truncate(machine.restoreCycle());
+        restore_seen = machine.restoreCount();
+    }
+}
+
+void WriteTrace::stop()
+{
+    if (machine.bus->tracer == this) {
+        machine.bus->tracer = nullptr;
+    }
+}
+
+void WriteTrace::clear()
+{
+    chunks.clear();
+    file.reset();
+    spilled = 0;
+    total = 0;
+}
+
+void WriteTrace::truncate(uint64_t cycle)
+{
+    while (!chunks.empty() && chunks.back()->first_cycle >= cycle) {
+        total -= chunks.back()->count;
+        chunks.pop_back();
+    }
+    // 溢出文件只追加，丢掉的块在文件里的数据不再有人引用
+    spilled = std::min(spilled, chunks.size());
+    if (chunks.empty() || chunks.back()->last_cycle < cycle) {
+        return;
+    }
+
+    Chunk& c = *chunks.back();
+    if (!c.records) {
+        // 要截断的块已经溢出到文件，先读回内存
+        const Record* old = recordsOf(c);
+        if (old == nullptr) {
+            total -= c.count;
+            chunks.pop_back();
+            spilled = std::min(spilled, chunks.size());
+            return;
+        }
+        c.records = std::make_unique<Record[]>(CHUNK_RECORDS);
+        std::copy(old, old + c.count, c.records.get());
+        spilled--;
+    }
+
+    const Record* records = c.records.get();
+    const size_t keep = static_cast<size_t>(std::lower_bound(records, records + c.count, cycle,
+        [](const Record& r, uint64_t v) { return r.cycle < v; }) - records);
+    total -= c.count - keep;
+    c.count = keep;
+    c.last_cycle = records[keep - 1].cycle;
+    c.addresses.fill(0);
+    for (size_t r = 0; r < keep; r++) {
+        c.addresses[records[r].address >> 6] |= 1ULL << (records[r].address & 63);
+    }
+}
+
+void WriteTrace::onWrite(uint16_t address, uint8_t data)
+{
+    const uint64_t cycle = machine.cpu.getCycleCount();
+    if (chunks.empty() || chunks.back()->count == CHUNK_RECORDS) {
+        auto chunk = std::make_unique<Chunk>();
+        chunk->records = std::make_unique<Record[]>(CHUNK_RECORDS);
+        chunk->first_cycle = cycle;
+        chunks.push_back(std::move(chunk));
+        if (chunks.size() - spilled > memory_chunks) {
+            spillOldest();
+        }
+    }
+
+    Chunk& c = *chunks.back();
+    c.records[c.count++] = { cycle, machine.cpu.getInstructionPc(), address, data, {} };
+    c.last_cycle = cycle;
+    c.addresses[address >> 6] |= 1ULL << (address & 63);
+    total++;
+}
+
+void WriteTrace::onRestore(uint64_t cycle)
+{
+    // 恢复点之后的记录属于被丢掉的时间线
+    truncate(cycle);
+    restore_seen = machine.restoreCount();
+}
+
+void WriteTrace::spillOldest()
+{
+    if (!file) {
+        file = std::make_unique<SpillFile>(spill_path);
+        if (!file->isOpen()) {
+            spdlog::error("WriteTrace: can not create {}, keeping the trace in memory", spill_path);
+        }
+    }
+    if (!file->isOpen()) {
+        return;
+    }
+
+    Chunk& c = *chunks[spilled];
+    if (!file->append(c.records.get(), c.count * sizeof(Record), c.file_offset)) {
+        spdlog::error("WriteTrace: write to {} failed, keeping the trace in memory", spill_path);
+        return;
+    }
+    c.records.reset();
+    spilled++;
+}
+
+const WriteTrace::Record* WriteTrace::recordsOf(const Chunk& chunk) const
+{
+    if (chunk.records) {
+        return chunk.records.get();
+    }
+    const uint8_t* base = file->data();
+    return base != nullptr ? reinterpret_cast<const Record*>(base + chunk.file_offset) : nullptr;
+}
+
+std::vector<WriteTrace::Record> WriteTrace::lastWriters(uint16_t address, size_t n) const
+{
+    std::vector<Record> out;
+    for (size_t i = chunks.size(); i-- > 0 && out.size() < n;) {
+        const Chunk& c = *chunks[i];
+        if (!((c.addresses[address >> 6] >> (address & 63)) & 1)) {
+            continue;
+        }
+        const Record* records = recordsOf(c);
+        if (records == nullptr) {
+            break;
+        }
+        for (size_t r = c.count; r-- > 0 && out.size() < n;) {
+            if (records[r].address == address) {
+                out.push_back(records[r]);
+            }
+        }
+    }
+    return out;
+}
+
+std::vector<WriteTrace::Record> WriteTrace::writesInRange(uint64_t first, uint64_t last, size_t limit) const
+{
+    std::vector<Record> out;
+    // 块按周期有序，二分找到第一个可能相交的块
+    auto it = std::lower_bound(chunks.begin(), chunks.end(), first,
+        [](const std::unique_ptr<Chunk>& c, uint64_t v) { return c->last_cycle < v; });
+    for (; it != chunks.end() && (*it)->first_cycle <= last && out.size() < limit; ++it) {
+        const Chunk& c = **it;
+        const Record* records = recordsOf(c);
+        if (records == nullptr) {
+            break;
+        }
+        const Record* begin = std::lower_bound(records, records + c.count, first,
+            [](const Record& r, uint64_t v) { return r.cycle < v; });
+        for (const Record* r = begin; r != records + c.count && r->cycle <= last && out.size() < limit; ++r) {
+            out.push_back(*r);
+        }
+    }
+    return out;
+}
+}